@@ -6,17 +6,16 @@
  * follows. The program creates Person structs to store each person and their relevant family 
  * connections, allowing for redundancy (i.e. when person is first created they are assigned
  * sex "male" and later another person has them listed as "father", implying being male again). 
- * After storing the input in a red-black tree, the program uses a type of breadth-first search
- * to print the people in order, parents first.
+ * People are stored in a hash table keyed on their names, so each line costs a single lookup that
+ * finds the person or creates them. After the input is read, the people are sorted by name once and
+ * the program uses a type of breadth-first search to print them in order, parents first.
  * 09/07/2020 */
 
 #include "fields.h"
 #include "jval.h"
 #include "dllist.h"
-#include "jrb.h"
 #include <string.h>
 #include <stdlib.h>
-#include <stdbool.h>
 
 typedef struct Person 
 {
@@ -27,9 +26,28 @@ typedef struct Person
 	Dllist children;
 	int printed;
 	int visited;
+	unsigned int hash;
+	struct Person* next;
 } *Person;
 
-char* get_name(IS is, bool isPerson);
+//number of buckets the people table starts with, doubled whenever there are more people than buckets
+#define FIRST_SIZE 1024
+
+//all people by name, chained through each Person's next
+typedef struct People
+{
+	Person* buckets;
+	unsigned int size;
+	unsigned int count;
+} *People;
+
+void get_name(IS is, char* name);
+People make_people();
+Person find_or_insert(People people, char* name);
+Person* sorted_people(People people);
+int compare_people(const void* a, const void* b);
+unsigned int hash_name(char* name);
+void grow(People people);
 int is_descendant(Person p);
 int check_sex(IS is, Person p, char* sex);
 
@@ -37,11 +55,11 @@ int main()
 {
 	IS is;
 	is = new_inputstruct(NULL);
-	JRB people = make_jrb();
-	JRB tmp;
-	int i;
+	People people = make_people();
+	Person* sorted;
+	unsigned int i;
 	Person p, subp;
-	char* name;
+	char name[MAXLEN];
 
 	//begin reading input from stdin
 	while(get_line(is) >= 0)
@@ -53,51 +71,16 @@ int main()
 		//finds PERSON line, stores in Person pointer p
 		if(strcmp(is->fields[0], "PERSON") == 0)
 		{
-			//if this person hasn't been created (not in the jrb tree), create and insert
-			name = get_name(is, true);
-			if(jrb_find_str(people, name) == NULL)
-			{
-				//initialize all members
-				p = malloc(sizeof(struct Person));
-				p->name = name;
-				p->children = new_dllist();
-				p->father = NULL;
-				p->mother = NULL;
-				p->sex = NULL;
-				p->printed = 0;
-				p->visited = 0;
-				jrb_insert_str(people, name, new_jval_v(p));
-			}
-			else
-			{	
-				//if already created and in tree, get person from tree to be used for lines under PERSON keyword and free duplicate name
-				p = jrb_find_str(people, name)->val.v;
-				free(name);
-			}
+			//get this person, creating them the first time they're named. p is used for lines under PERSON keyword
+			get_name(is, name);
+			p = find_or_insert(people, name);
 		}		
 		else
 		{
-			//if a person comes up under PERSON keyword, also check if they exist and create and insert
-			name = get_name(is, false);
-			if(jrb_find_str(people, name) == NULL && strcmp(is->fields[0], "SEX") != 0)
-			{
-				//initialize members and store Person in subp pointer. p is PERSON, subp is person related to PERSON
-				subp = malloc(sizeof(struct Person));
-				subp->name = name;
-				subp->children = new_dllist();
-				subp->father = NULL;
-				subp->mother = NULL;
-				subp->sex = NULL;
-				subp->printed = 0;
-				subp->visited = 0;
-				jrb_insert_str(people, name, new_jval_v(subp));
-			}
-			else if(strcmp(is->fields[0], "SEX") != 0)
-			{
-				//if already created and in tree, get person from tree
-				subp = jrb_find_str(people, name)->val.v;
-				free(name);
-			}
+			//a person that comes up under PERSON keyword is also found or created and stored in subp. p is PERSON, subp is person related to PERSON
+			get_name(is, name);
+			if(strcmp(is->fields[0], "SEX") != 0)
+				subp = find_or_insert(people, name);
 			
 			//begin checking sub keywords to assign family links and sex
 			if(strcmp(is->fields[0], "FATHER_OF") == 0)
@@ -105,13 +88,14 @@ int main()
 				//error checking sex and duplicate parent
 				if(check_sex(is, p, "Male"))
 					return -1;
-				if(subp->father != NULL && strcmp(subp->father->name, name) != 0)
+				if(subp->father != NULL && subp->father != p)
 				{
 					fprintf(stderr, "Bad input -- child with two fathers on line %d\n", is->line);
 					return -1;
 				}
-				//add subp as child of p, assign sex
-				dll_append(p->children, new_jval_v(subp));
+				//add subp as child of p unless it already is, assign sex
+				if(subp->father == NULL)
+					dll_append(p->children, new_jval_v(subp));
 				p->sex = "Male";
 
 				subp->father = p;
@@ -121,13 +105,14 @@ int main()
 				//error checking sex and duplicate parent
 				if(check_sex(is, p, "Female"))
 					return -1;
-				if(subp->mother != NULL && strcmp(subp->mother->name, name) != 0)
+				if(subp->mother != NULL && subp->mother != p)
 				{
 					fprintf(stderr, "Bad input -- child with two mothers on line %d\n", is->line);
 					return -1;
 				}
-				//add subp as child of p, assign sex
-				dll_append(p->children, new_jval_v(subp));
+				//add subp as child of p unless it already is, assign sex
+				if(subp->mother == NULL)
+					dll_append(p->children, new_jval_v(subp));
 				p->sex = "Female";
 
 				subp->mother = p;
@@ -137,13 +122,14 @@ int main()
 				//error checking sex and duplicate parent
 				if(check_sex(is, subp, "Male"))
 					return -1;
-				if(p->father != NULL && strcmp(p->father->name, name) != 0)
+				if(p->father != NULL && p->father != subp)
 				{
 					fprintf(stderr, "Bad input -- child with two fathers on line %d\n", is->line);
 					return -1;
 				}
-				//add p as child of subp, assign sex
-				dll_append(subp->children, new_jval_v(p));
+				//add p as child of subp unless it already is, assign sex
+				if(p->father == NULL)
+					dll_append(subp->children, new_jval_v(p));
 				subp->sex = "Male";
 
 				p->father = subp;
@@ -153,13 +139,14 @@ int main()
 				//error checking sex and duplicate parent
 				if(check_sex(is, subp, "Female"))
 					return -1;
-				if(p->mother != NULL && strcmp(p->mother->name, name) != 0)
+				if(p->mother != NULL && p->mother != subp)
 				{
 					fprintf(stderr, "Bad input -- child with two mothers on line %d\n", is->line);
 					return -1;
 				}
-				//add p as child of subp, assign sex
-				dll_append(subp->children, new_jval_v(p));
+				//add p as child of subp unless it already is, assign sex
+				if(p->mother == NULL)
+					dll_append(subp->children, new_jval_v(p));
 				subp->sex = "Female";
 
 				p->mother = subp;
@@ -167,7 +154,7 @@ int main()
 			else if(strcmp(is->fields[0], "SEX") == 0)
 			{
 				//check and assign sex
-				if(strcmp(get_name(is, false), "M") == 0)
+				if(strcmp(name, "M") == 0)
 				{	
 					if(check_sex(is, p, "Male"))
 							return -1;
@@ -183,12 +170,14 @@ int main()
 		}
 	}
 
-	//end of input, begin check for cycles
+	//end of input, sort everyone by name so they are visited in the same order every time
 	Dllist ptr;
+	sorted = sorted_people(people);
 	
-	//traverse entire tree, check each Person for cyclical relationship
-	jrb_traverse(tmp, people) {
-		if(is_descendant((Person)tmp->val.v))
+	//check each Person for cyclical relationship
+	for(i = 0; i < people->count; i++)
+	{
+		if(is_descendant(sorted[i]))
 		{	
 			fprintf(stderr, "Bad input -- cycle in specification\n");
 			return -1;
@@ -198,9 +187,10 @@ int main()
 	//end cycle check, begin preparing for printing
 	Dllist toprint = new_dllist();
 
-	//traverse entire tree, add all people without parents to queue (dllist)
-	jrb_traverse(tmp, people) {
-		p = (Person) tmp->val.v;
+	//add all people without parents to queue (dllist)
+	for(i = 0; i < people->count; i++)
+	{
+		p = sorted[i];
 		if(p->mother == NULL && p->father == NULL)
 		{
 			dll_append(toprint, new_jval_v(p));
@@ -256,15 +246,10 @@ int main()
 
 //processes name from each line, slightly modified version of c-style string reading from Dr. Plank's red-black tree lecture notes
 //also can be used to extract 'M' or 'F' sex character
-char* get_name(IS is, bool isPerson)
+//the name is copied into name, which has room for a whole line, and only copied again if it's a new person
+void get_name(IS is, char* name)
 {
-	int fullname_size = strlen(is->text1) - strlen(is->fields[0]) - 1; //name size including whitespace and \0 is the entire length of the line minus the tag length and \n
-	//lines that correspond to subp, under PERSON keywords, are indented by two spaces
-	if(!isPerson)
-		fullname_size -= 2;
-	
-	//copy each part of name directly into allocated memory instead of using strcat
-	char* name = malloc(fullname_size);
+	//copy each part of name directly into name instead of using strcat
 	strcpy(name, is->fields[1]);
 	int name_size = strlen(is->fields[1]);
 
@@ -275,8 +260,104 @@ char* get_name(IS is, bool isPerson)
 		strcpy(name + name_size + 1, is->fields[i]);
 		name_size += strlen(name + name_size);
 	}
+}
+
+People make_people()
+{
+	People people = malloc(sizeof(struct People));
+	people->size = FIRST_SIZE;
+	people->count = 0;
+	people->buckets = calloc(people->size, sizeof(Person));
+
+	return people;
+}
+
+//returns the person with this name, creating them with a copy of name if they don't exist yet
+Person find_or_insert(People people, char* name)
+{
+	unsigned int hash = hash_name(name);
+	unsigned int bucket = hash & (people->size - 1);
+	Person p;
+
+	for(p = people->buckets[bucket]; p != NULL; p = p->next)
+	{
+		if(p->hash == hash && strcmp(p->name, name) == 0)
+			return p;
+	}
+
+	//initialize all members
+	p = malloc(sizeof(struct Person));
+	p->name = strdup(name);
+	p->children = new_dllist();
+	p->father = NULL;
+	p->mother = NULL;
+	p->sex = NULL;
+	p->printed = 0;
+	p->visited = 0;
+	p->hash = hash;
+	p->next = people->buckets[bucket];
+	people->buckets[bucket] = p;
+	people->count++;
 
-	return name;
+	if(people->count > people->size)
+		grow(people);
+
+	return p;
+}
+
+//array of every person sorted by name, the order the red-black tree used to keep them in
+Person* sorted_people(People people)
+{
+	Person* sorted = malloc((people->count + 1) * sizeof(Person));
+	unsigned int b, n = 0;
+	Person p;
+
+	for(b = 0; b < people->size; b++)
+	{
+		for(p = people->buckets[b]; p != NULL; p = p->next)
+			sorted[n++] = p;
+	}
+	qsort(sorted, n, sizeof(Person), compare_people);
+
+	return sorted;
+}
+
+int compare_people(const void* a, const void* b)
+{
+	return strcmp((*(Person*) a)->name, (*(Person*) b)->name);
+}
+
+//32-bit FNV-1a of a name
+unsigned int hash_name(char* name)
+{
+	unsigned int h = 2166136261u;
+
+	for(; *name != '\0'; name++)
+		h = (h ^ (unsigned char) *name) * 16777619u;
+
+	return h;
+}
+
+//doubles the number of buckets and moves every person to their new bucket
+void grow(People people)
+{
+	Person* old = people->buckets;
+	unsigned int b, old_size = people->size;
+	Person p, next;
+
+	people->size *= 2;
+	people->buckets = calloc(people->size, sizeof(Person));
+
+	for(b = 0; b < old_size; b++)
+	{
+		for(p = old[b]; p != NULL; p = next)
+		{
+			next = p->next;
+			p->next = people->buckets[p->hash & (people->size - 1)];
+			people->buckets[p->hash & (people->size - 1)] = p;
+		}
+	}
+	free(old);
 }
 
 //depth-first search to verify that there aren't cycles in the tree, i.e. no person is their own parent
@@ -0,0 +1,1038 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab2: hostdb.c
+ * Implementation of the host database in hostdb.h. Names are kept in a chained hash table (FNV-1a,
+ * power of two size, doubled when there are as many names as buckets), so finding every computer
+ * with a name only looks at one bucket. A name can belong to several computers, and they are found
+ * in the order they were added: names that match are kept in a row in their bucket, and the first
+ * of them knows the last, so adding another costs the same however many there are, and a lookup
+ * skips over the whole run of a name that doesn't match. Buckets and chains are indexes into the
+ * names array, so the whole table is four arrays that grow by doubling.
+ * "converted" is a list of records of
+ *   4 bytes of ip, a 4-byte big-endian count of names, then that many '\0' terminated names
+ * and an absolute name (one with a '.') also gives its computer the local name before the '.'.
+ * A local name is stored as the first len bytes of its absolute name, so each name's bytes are
+ * kept once. hostdb_add_name() copies them to the arena, while hostdb_map() parses a mapped file
+ * in place and its names point into the mapping, so a file of any size is bounded by how fast
+ * its pages come in. hostdb_read() reads the file into the arena and parses it there the same way.
+ * Computers are also found by address: the first query by address sorts them by addr, and an
+ * address or a CIDR block like 10.1.0.0/16 is a binary search for the start of its run.
+ * Queries are answered through HostKeys, the sorted names and the computers behind a set of
+ * callbacks, so the index in hostidx.c is parsed and searched by the same code as the database.
+ * 09/14/2020 */
+
+#include "hostdb.h"
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define FIRST_SIZE 1024
+#define FIRST_ARENA 65536
+
+//keys found by a prefix or fuzzy query, or computers, in an array that doubles when it fills up
+typedef struct Matches
+{
+	int* found;
+	int count;
+	int size;
+} Matches;
+
+//the database being sorted, for compare_by_name()
+static HostDB sort_db;
+
+static void parse(HostDB db, long size);
+static void add_names(HostDB db, long off, int len);
+static void insert(HostDB db, long off, int len, int computer);
+static unsigned int hash_name(char* name, int len);
+static int find_len(HostDB db, char* name, int len, unsigned int hash);
+static void grow(HostDB db);
+static void sort_addrs(HostDB db);
+static void sort_names(HostDB db);
+static int compare_keys(const void* a, const void* b);
+static int compare_by_name(const void* a, const void* b);
+static HostName* name_at(HostDB db, int i);
+static void make_keys(HostDB db, HostKeys* keys);
+static int db_num_keys(void* data);
+static bool db_key(void* data, int i, char** name, int* len);
+static int db_computers(void* data, int i, int** ids);
+static int db_range(void* data, uint32_t low, uint32_t high, int** ids);
+static bool db_find(FILE* f, void* data, char* name);
+static void db_print(FILE* f, void* data, int computer);
+static int key_char(HostKeys* keys, int i, int depth);
+static int lower_bound(HostKeys* keys, int start, int end, char* s, int len);
+static int prefix_end(HostKeys* keys, int start, int end, char* s, int len);
+static void fuzzy_keys(HostKeys* keys, char* word, int max_edits, Matches* matches);
+static void fuzzy(HostKeys* keys, int start, int end, int depth, char* word, int len, int* row, int max_edits, Matches* matches);
+static void start_matches(Matches* matches);
+static void add_match(Matches* matches, int found);
+static void fprint_matches(FILE* f, HostKeys* keys, Matches* matches, char* input);
+static int compare_ints(const void* a, const void* b);
+static int format_ip(char* out, uint32_t addr);
+static char* parse_number(char* s, unsigned int max, unsigned int* n);
+
+HostDB make_hostdb()
+{
+	HostDB db = malloc(sizeof(struct HostDB));
+
+	db->computers_size = FIRST_SIZE;
+	db->num_computers = 0;
+	db->addrs = malloc(db->computers_size * sizeof(uint32_t));
+	db->first_name = malloc(db->computers_size * sizeof(int));
+
+	db->names_size = FIRST_SIZE;
+	db->count = 0;
+	db->names = malloc(db->names_size * sizeof(HostName));
+	db->size = FIRST_SIZE;
+	db->buckets = malloc(db->size * sizeof(int));
+	memset(db->buckets, 0xff, db->size * sizeof(int));
+
+	db->text = NULL;
+	db->arena = NULL;
+	db->arena_used = 0;
+	db->arena_size = 0;
+	db->map = NULL;
+	db->map_size = 0;
+	db->by_ip = NULL;
+	db->by_ip_count = 0;
+	db->by_name = NULL;
+	db->by_name_count = 0;
+
+	return db;
+}
+
+/* adds a computer from the 8 bytes that start its record, 4 bytes of ip and a 4-byte big-endian
+ * count of names, and returns that count. Its names are added with hostdb_add_name() */
+int hostdb_add_computer(HostDB db, unsigned char* header)
+{
+	if(db->num_computers == db->computers_size)
+	{
+		db->computers_size *= 2;
+		db->addrs = realloc(db->addrs, db->computers_size * sizeof(uint32_t));
+		db->first_name = realloc(db->first_name, db->computers_size * sizeof(int));
+	}
+
+	db->addrs[db->num_computers] = ((uint32_t) header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+	db->first_name[db->num_computers] = db->count;
+	db->num_computers++;
+
+	return (header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
+}
+
+/* adds a name of len bytes to the computer added last, copying it to the arena. An absolute name
+ * (one with a '.') adds the local name before the '.' first */
+void hostdb_add_name(HostDB db, char* name, int len)
+{
+	if(db->arena_used + len > db->arena_size)
+	{
+		if(db->arena_size == 0)
+			db->arena_size = FIRST_ARENA;
+		while(db->arena_used + len > db->arena_size)
+			db->arena_size *= 2;
+		db->arena = realloc(db->arena, db->arena_size);
+	}
+
+	memcpy(db->arena + db->arena_used, name, len);
+	db->text = db->arena;
+	add_names(db, db->arena_used, len);
+	db->arena_used += len;
+}
+
+//first name that matches name, or -1 if no computer has it
+int hostdb_find(HostDB db, char* name)
+{
+	int len = strlen(name);
+
+	return find_len(db, name, len, hash_name(name, len));
+}
+
+//next name that matches the same as name, or -1 if there are no more
+int hostdb_next(HostDB db, int name)
+{
+	HostName* entry = &db->names[name];
+	int next = entry->next;
+
+	//names that match are in a row, so the run ends at the first one that doesn't
+	if(next >= 0 && db->names[next].hash == entry->hash && db->names[next].len == entry->len
+		&& memcmp(db->text + db->names[next].off, db->text + entry->off, entry->len) == 0)
+		return next;
+
+	return -1;
+}
+
+//how many names a computer has, local names included
+int hostdb_num_names(HostDB db, int computer)
+{
+	if(computer + 1 < db->num_computers)
+		return db->first_name[computer + 1] - db->first_name[computer];
+
+	return db->count - db->first_name[computer];
+}
+
+//sorts what queries by address and by prefix use, call it before sharing the database between threads
+void hostdb_prepare(HostDB db)
+{
+	if(db->by_ip == NULL || db->by_ip_count != db->num_computers)
+		sort_addrs(db);
+	if(db->by_name == NULL || db->by_name_count != db->count)
+		sort_names(db);
+}
+
+/* finds the computers with addresses from low to high, in order of address and then of when they
+ * were added. *first is set to the first of their ids and the number of them is returned. The
+ * array is the database's own and is good until a computer is added */
+int hostdb_range(HostDB db, uint32_t low, uint32_t high, int** first)
+{
+	int start, end, mid;
+
+	hostdb_prepare(db);
+
+	//first computer at or above low
+	start = 0;
+	end = db->by_ip_count;
+	while(start < end)
+	{
+		mid = start + (end - start) / 2;
+		if(db->addrs[db->by_ip[mid]] < low)
+			start = mid + 1;
+		else
+			end = mid;
+	}
+
+	*first = db->by_ip + start;
+	for(end = start; end < db->by_ip_count && db->addrs[db->by_ip[end]] <= high; end++);
+
+	return end - start;
+}
+
+/* finds the names that start with prefix, in order of their bytes and then of when they were
+ * added. *first is set to the first of them and the number of them is returned, the array is
+ * the database's own like in hostdb_range() */
+int hostdb_prefix(HostDB db, char* prefix, int** first)
+{
+	HostKeys keys;
+	int len = strlen(prefix);
+	int start, count;
+
+	make_keys(db, &keys);
+	count = db_num_keys(db);
+	start = lower_bound(&keys, 0, count, prefix, len);
+	*first = db->by_name + start;
+
+	return prefix_end(&keys, start, count, prefix, len) - start;
+}
+
+/* finds the names at most max_edits insertions, deletions or changes of one character away from
+ * word, in the same order as hostdb_prefix(). *found is set to a new array of them and the number
+ * of them is returned */
+int hostdb_fuzzy(HostDB db, char* word, int max_edits, int** found)
+{
+	HostKeys keys;
+	Matches matches;
+	int i;
+
+	make_keys(db, &keys);
+	fuzzy_keys(&keys, word, max_edits, &matches);
+
+	//the keys are places in by_name
+	for(i = 0; i < matches.count; i++)
+		matches.found[i] = db->by_name[matches.found[i]];
+	*found = matches.found;
+
+	return matches.count;
+}
+
+//orders names by their bytes, and a name before any longer name it starts
+int compare_names(char* a, int a_len, char* b, int b_len)
+{
+	int cmp = memcmp(a, b, (a_len < b_len) ? a_len : b_len);
+
+	if(cmp != 0)
+		return cmp;
+	if(a_len == b_len)
+		return 0;
+
+	return (a_len < b_len) ? -1 : 1;
+}
+
+/* reads an address like 10.1.2.3, or a CIDR block like 10.1.0.0/16, into the lowest and highest
+ * addresses it covers. Returns false if s isn't one */
+bool parse_cidr(char* s, uint32_t* low, uint32_t* high)
+{
+	unsigned int part, bits = 32;
+	uint32_t addr = 0, mask;
+	int i;
+
+	for(i = 0; i < 4; i++)
+	{
+		if(i > 0 && *s++ != '.')
+			return false;
+		s = parse_number(s, 255, &part);
+		if(s == NULL)
+			return false;
+		addr = (addr << 8) | part;
+	}
+
+	if(*s == '/')
+	{
+		s = parse_number(s + 1, 32, &bits);
+		if(s == NULL)
+			return false;
+	}
+	if(*s != '\0')
+		return false;
+
+	//bits == 0 would shift by 32
+	mask = (bits == 0) ? 0 : 0xffffffffu << (32 - bits);
+	*low = addr & mask;
+	*high = addr | ~mask;
+
+	return true;
+}
+
+/* reads "converted" into an empty database by mapping it and adding every computer and name
+ * straight from the mapping. Returns false if the file can't be opened or mapped */
+bool hostdb_map(HostDB db, char* path)
+{
+	struct stat fileStat;
+	int f;
+
+	f = open(path, O_RDONLY);
+	if(f < 0)
+		return false;
+	if(fstat(f, &fileStat) < 0)
+	{
+		close(f);
+		return false;
+	}
+
+	//an empty file can't be mapped, but it is an empty database
+	if(fileStat.st_size == 0)
+	{
+		close(f);
+		return true;
+	}
+
+	db->map_size = fileStat.st_size;
+	db->map = mmap(NULL, db->map_size, PROT_READ, MAP_PRIVATE, f, 0);
+	close(f);
+	if(db->map == MAP_FAILED)
+	{
+		db->map = NULL;
+		return false;
+	}
+	madvise(db->map, db->map_size, MADV_WILLNEED);
+	db->text = db->map;
+	parse(db, db->map_size);
+
+	return true;
+}
+
+/* hostdb_map(), but the file is read into the arena instead of mapped. The database doesn't
+ * depend on the file afterwards, so it can be rewritten or truncated while the database is in
+ * use. Returns false if the file can't be read */
+bool hostdb_read(HostDB db, char* path)
+{
+	struct stat fileStat;
+	ssize_t got;
+	long size = 0;
+	int f;
+
+	f = open(path, O_RDONLY);
+	if(f < 0)
+		return false;
+	if(fstat(f, &fileStat) < 0)
+	{
+		close(f);
+		return false;
+	}
+
+	//the whole file is the arena, names are parsed in place like in a mapping
+	db->arena_size = fileStat.st_size + 1;
+	db->arena = malloc(db->arena_size);
+	while(size < fileStat.st_size && (got = read(f, db->arena + size, fileStat.st_size - size)) > 0)
+		size += got;
+	close(f);
+	if(size < fileStat.st_size)
+		return false;
+
+	db->arena_used = size;
+	db->text = db->arena;
+	parse(db, size);
+
+	return true;
+}
+
+//prints ip and all names of a computer
+void print_computer(HostDB db, int computer)
+{
+	fprint_computer(stdout, db, computer);
+}
+
+/* print_computer() to any stream. The whole computer is put together in one buffer and written
+ * with one fwrite(), instead of a call per part of the address and per name */
+void fprint_computer(FILE* f, HostDB db, int computer)
+{
+	char small[4096];
+	char* line = small;
+	HostName* name;
+	long size, len;
+	int i, first, last;
+
+	first = db->first_name[computer];
+	last = first + hostdb_num_names(db, computer);
+
+	//"255.255.255.255: ", each name and a space, then "\n\n"
+	size = 17 + 2;
+	for(i = first; i < last; i++)
+		size += db->names[i].len + 1;
+	if(size > (long) sizeof(small))
+		line = malloc(size);
+
+	len = format_ip(line, db->addrs[computer]);
+	line[len++] = ':';
+	line[len++] = ' ';
+	for(i = first; i < last; i++)
+	{
+		name = &db->names[i];
+		memcpy(line + len, db->text + name->off, name->len);
+		len += name->len;
+		line[len++] = ' ';
+	}
+	line[len++] = '\n';
+	line[len++] = '\n';
+
+	fwrite(line, 1, len, f);
+	if(line != small)
+		free(line);
+}
+
+//hostkeys_answer() from the database
+void hostdb_answer(FILE* f, HostDB db, char* input)
+{
+	HostKeys keys;
+
+	make_keys(db, &keys);
+	hostkeys_answer(f, &keys, input);
+}
+
+/* writes the answer to one query to f: every computer with the name, every computer in an
+ * address or CIDR block (lowest address first), or every computer with a name that matches a
+ * prefix ("web*") or is close to a name ("webserv~" or "webserv~2") */
+void hostkeys_answer(FILE* f, HostKeys* keys, char* input)
+{
+	Matches matches;
+	int* found;
+	uint32_t low, high;
+	int i, count, start, end, len, max_edits;
+	char* tilde;
+	char word[MAX_INPUT + 1];
+
+	if(parse_cidr(input, &low, &high))
+	{
+		count = keys->range(keys->data, low, high, &found);
+		if(count == 0)
+			fprintf(f, "no key %s\n\n", input);
+		for(i = 0; i < count; i++)
+			keys->print(f, keys->data, found[i]);
+		return;
+	}
+
+	//"web*" prints every computer with a name that starts with web
+	len = strlen(input);
+	if(len > 0 && input[len - 1] == '*')
+	{
+		len--;
+		memcpy(word, input, len);
+		word[len] = '\0';
+		count = keys->num_keys(keys->data);
+		start = lower_bound(keys, 0, count, word, len);
+		end = prefix_end(keys, start, count, word, len);
+
+		start_matches(&matches);
+		for(i = start; i < end; i++)
+			add_match(&matches, i);
+		fprint_matches(f, keys, &matches, input);
+		free(matches.found);
+		return;
+	}
+
+	//"webserv~" prints every computer with a name one edit away from webserv, "webserv~2" two
+	tilde = strrchr(input, '~');
+	if(tilde != NULL && (tilde[1] == '\0' || (tilde[1] >= '0' && tilde[1] <= '0' + MAX_EDITS && tilde[2] == '\0')))
+	{
+		max_edits = (tilde[1] == '\0') ? 1 : tilde[1] - '0';
+		memcpy(word, input, tilde - input);
+		word[tilde - input] = '\0';
+		fuzzy_keys(keys, word, max_edits, &matches);
+		fprint_matches(f, keys, &matches, input);
+		free(matches.found);
+		return;
+	}
+
+	//if name exists, print ip and all names of every computer with it
+	if(!keys->find(f, keys->data, input))
+		fprintf(f, "no key %s\n\n", input);
+}
+
+/* gives standard output an OUTPUT_BUFFER buffer, so answers piped somewhere go out in big write()s.
+ * glibc ignores the size unless it is given the buffer too. Call it before anything is printed */
+void buffer_output()
+{
+	static char buffer[OUTPUT_BUFFER];
+
+	setvbuf(stdout, buffer, _IOFBF, OUTPUT_BUFFER);
+}
+
+//hostkeys_query() from the database
+void hostdb_query(HostDB db, bool batch)
+{
+	HostKeys keys;
+
+	make_keys(db, &keys);
+	hostkeys_query(&keys, batch);
+}
+
+/* answers host names read from standard input until EOF. In batch mode there is no prompt, so a
+ * file of names can be piped in and only the answers come out */
+void hostkeys_query(HostKeys* keys, bool batch)
+{
+	char input[MAX_INPUT + 1];
+
+	if(!batch)
+		printf("Hosts all read in\n\n");
+	else
+		buffer_output();
+
+	//prompt continuously until EOF
+	while(1)
+	{
+		if(!batch)
+			printf("Enter host name: ");
+
+		if(scanf("%1000s", input) == EOF)
+			break;
+
+		hostkeys_answer(stdout, keys, input);
+	}
+}
+
+//frees the database and unmaps its file, if it has one
+void free_hostdb(HostDB db)
+{
+	free(db->addrs);
+	free(db->first_name);
+	free(db->names);
+	free(db->buckets);
+	free(db->arena);
+	free(db->by_ip);
+	free(db->by_name);
+	if(db->map != NULL)
+		munmap(db->map, db->map_size);
+	free(db);
+}
+
+/* adds every computer in the first size bytes of text, which hold a whole "converted". A
+ * computer whose record is cut off by the end of the file keeps the names that were all there */
+static void parse(HostDB db, long size)
+{
+	char* pos = db->text;
+	char* end = db->text + size;
+	char* name_end;
+	int i, names;
+
+	while(end - pos >= 8)
+	{
+		names = hostdb_add_computer(db, (unsigned char*) pos);
+		pos += 8;
+
+		//each name ends at its '\0'
+		for(i = 0; i < names; i++)
+		{
+			name_end = memchr(pos, '\0', end - pos);
+			if(name_end == NULL)
+				break;
+			add_names(db, pos - db->text, name_end - pos);
+			pos = name_end + 1;
+		}
+		if(i < names)
+			break;
+	}
+}
+
+//a name at off in the text, and first the local name at its start if it has a '.'
+static void add_names(HostDB db, long off, int len)
+{
+	char* dot = memchr(db->text + off, '.', len);
+
+	if(dot != NULL)
+		insert(db, off, dot - (db->text + off), db->num_computers - 1);
+	insert(db, off, len, db->num_computers - 1);
+}
+
+/* adds a name of a computer. A repeated name goes right after the last of the names already there,
+ * a new one at the front of its bucket */
+static void insert(HostDB db, long off, int len, int computer)
+{
+	HostName* entry;
+	int first, last, bucket;
+
+	if(db->count == (int) db->size)
+		grow(db);
+	if(db->count == db->names_size)
+	{
+		db->names_size *= 2;
+		db->names = realloc(db->names, db->names_size * sizeof(HostName));
+	}
+
+	entry = &db->names[db->count];
+	entry->off = off;
+	entry->len = len;
+	entry->hash = hash_name(db->text + off, len);
+	entry->computer = computer;
+
+	first = find_len(db, db->text + off, len, entry->hash);
+	if(first < 0)
+	{
+		bucket = entry->hash & (db->size - 1);
+		entry->next = db->buckets[bucket];
+		entry->last = db->count;
+		db->buckets[bucket] = db->count;
+	}
+	else
+	{
+		last = db->names[first].last;
+		entry->next = db->names[last].next;
+		entry->last = -1;
+		db->names[last].next = db->count;
+		db->names[first].last = db->count;
+	}
+	db->count++;
+}
+
+//32-bit FNV-1a of len bytes
+static unsigned int hash_name(char* name, int len)
+{
+	unsigned int h = 2166136261u;
+	int i;
+
+	for(i = 0; i < len; i++)
+		h = (h ^ (unsigned char) name[i]) * 16777619u;
+
+	return h;
+}
+
+static int find_len(HostDB db, char* name, int len, unsigned int hash)
+{
+	HostName* entry;
+	int i;
+
+	//only the first name of each run is compared, the rest of the run is skipped
+	for(i = db->buckets[hash & (db->size - 1)]; i >= 0; i = db->names[entry->last].next)
+	{
+		entry = &db->names[i];
+		if(entry->hash == hash && entry->len == len && memcmp(db->text + entry->off, name, len) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/* doubles the number of buckets. Names are moved over from the back of each chain so names
+ * that match stay in the same order */
+static void grow(HostDB db)
+{
+	int* old = db->buckets;
+	int i, next, reversed;
+	unsigned int old_size = db->size;
+	unsigned int b, bucket;
+
+	db->size *= 2;
+	db->buckets = malloc(db->size * sizeof(int));
+	memset(db->buckets, 0xff, db->size * sizeof(int));
+
+	for(b = 0; b < old_size; b++)
+	{
+		//reverse the chain, then push each name onto its new bucket
+		reversed = -1;
+		for(i = old[b]; i >= 0; i = next)
+		{
+			next = db->names[i].next;
+			db->names[i].next = reversed;
+			reversed = i;
+		}
+		for(i = reversed; i >= 0; i = next)
+		{
+			next = db->names[i].next;
+			bucket = db->names[i].hash & (db->size - 1);
+			db->names[i].next = db->buckets[bucket];
+			db->buckets[bucket] = i;
+		}
+	}
+	free(old);
+}
+
+//by_ip sorted as address and id in one number, so computers with the same address keep their order
+static void sort_addrs(HostDB db)
+{
+	uint64_t* keys;
+	int i;
+
+	keys = malloc((db->num_computers + 1) * sizeof(uint64_t));
+	for(i = 0; i < db->num_computers; i++)
+		keys[i] = ((uint64_t) db->addrs[i] << 32) | i;
+	qsort(keys, db->num_computers, sizeof(uint64_t), compare_keys);
+
+	free(db->by_ip);
+	db->by_ip = malloc((db->num_computers + 1) * sizeof(int));
+	for(i = 0; i < db->num_computers; i++)
+		db->by_ip[i] = (int) (keys[i] & 0xffffffff);
+	db->by_ip_count = db->num_computers;
+	free(keys);
+}
+
+static void sort_names(HostDB db)
+{
+	int i;
+
+	free(db->by_name);
+	db->by_name = malloc((db->count + 1) * sizeof(int));
+	for(i = 0; i < db->count; i++)
+		db->by_name[i] = i;
+	sort_db = db;
+	qsort(db->by_name, db->count, sizeof(int), compare_by_name);
+	db->by_name_count = db->count;
+}
+
+static int compare_keys(const void* a, const void* b)
+{
+	uint64_t x = *(uint64_t*) a;
+	uint64_t y = *(uint64_t*) b;
+
+	if(x == y)
+		return 0;
+
+	return (x < y) ? -1 : 1;
+}
+
+//names of sort_db by their bytes, then by the order they were added
+static int compare_by_name(const void* a, const void* b)
+{
+	int x = *(int*) a;
+	int y = *(int*) b;
+	HostName* name_x = &sort_db->names[x];
+	HostName* name_y = &sort_db->names[y];
+	int cmp = compare_names(sort_db->text + name_x->off, name_x->len, sort_db->text + name_y->off, name_y->len);
+
+	if(cmp != 0)
+		return cmp;
+	if(x == y)
+		return 0;
+
+	return (x < y) ? -1 : 1;
+}
+
+//the i'th name in order
+static HostName* name_at(HostDB db, int i)
+{
+	return &db->names[db->by_name[i]];
+}
+
+//the database as keys, key i is the i'th name in order
+static void make_keys(HostDB db, HostKeys* keys)
+{
+	keys->data = db;
+	keys->num_keys = db_num_keys;
+	keys->key = db_key;
+	keys->computers = db_computers;
+	keys->range = db_range;
+	keys->find = db_find;
+	keys->print = db_print;
+}
+
+static int db_num_keys(void* data)
+{
+	HostDB db = data;
+
+	hostdb_prepare(db);
+
+	return db->by_name_count;
+}
+
+static bool db_key(void* data, int i, char** name, int* len)
+{
+	HostDB db = data;
+	HostName* entry = name_at(db, i);
+
+	*name = db->text + entry->off;
+	*len = entry->len;
+
+	return true;
+}
+
+//each name is one computer's
+static int db_computers(void* data, int i, int** ids)
+{
+	*ids = &name_at(data, i)->computer;
+
+	return 1;
+}
+
+static int db_range(void* data, uint32_t low, uint32_t high, int** ids)
+{
+	return hostdb_range(data, low, high, ids);
+}
+
+//the hash table instead of a search of the sorted names
+static bool db_find(FILE* f, void* data, char* name)
+{
+	HostDB db = data;
+	int i = hostdb_find(db, name);
+
+	if(i < 0)
+		return false;
+	for(; i >= 0; i = hostdb_next(db, i))
+		fprint_computer(f, db, db->names[i].computer);
+
+	return true;
+}
+
+static void db_print(FILE* f, void* data, int computer)
+{
+	fprint_computer(f, data, computer);
+}
+
+//character depth of key i, or -1 if the key is only depth characters long or can't be read
+static int key_char(HostKeys* keys, int i, int depth)
+{
+	char* name;
+	int len;
+
+	if(!keys->key(keys->data, i, &name, &len) || depth >= len)
+		return -1;
+
+	return (unsigned char) name[depth];
+}
+
+//first key from start to end that doesn't sort before s (len bytes), a key that can't be read doesn't
+static int lower_bound(HostKeys* keys, int start, int end, char* s, int len)
+{
+	char* name;
+	int name_len, mid;
+
+	while(start < end)
+	{
+		mid = start + (end - start) / 2;
+		if(keys->key(keys->data, mid, &name, &name_len) && compare_names(name, name_len, s, len) < 0)
+			start = mid + 1;
+		else
+			end = mid;
+	}
+
+	return start;
+}
+
+//end of the run of keys from start that begin with s (len bytes)
+static int prefix_end(HostKeys* keys, int start, int end, char* s, int len)
+{
+	char* name;
+	int name_len;
+
+	for(; start < end; start++)
+	{
+		if(!keys->key(keys->data, start, &name, &name_len) || name_len < len || memcmp(name, s, len) != 0)
+			break;
+	}
+
+	return start;
+}
+
+/* sets matches to a new list of the keys at most max_edits edits away from word, in order.
+ * Keys that start the same are next to each other, so they are searched like a trie: a run of
+ * keys that share their first depth characters is split by the next character, and a run is only
+ * followed while the edit distance between word and what the keys in it start with can still be
+ * max_edits or less. Only the keys near word are looked at */
+static void fuzzy_keys(HostKeys* keys, char* word, int max_edits, Matches* matches)
+{
+	int* row;
+	int i, len = strlen(word);
+
+	start_matches(matches);
+
+	//distance from the empty prefix to each start of word
+	row = malloc((len + 1) * sizeof(int));
+	for(i = 0; i <= len; i++)
+		row[i] = i;
+	fuzzy(keys, 0, keys->num_keys(keys->data), 0, word, len, row, max_edits, matches);
+	free(row);
+}
+
+/* the keys from start to end all have the same first depth characters, and row[j] is the edit
+ * distance between those characters and the first j characters of word */
+static void fuzzy(HostKeys* keys, int start, int end, int depth, char* word, int len, int* row, int max_edits, Matches* matches)
+{
+	int* next_row;
+	int group_end, low, high, mid, j, best, c;
+
+	//keys that are just those characters come first
+	while(start < end && key_char(keys, start, depth) < 0)
+	{
+		if(row[len] <= max_edits)
+			add_match(matches, start);
+		start++;
+	}
+
+	next_row = malloc((len + 1) * sizeof(int));
+	while(start < end)
+	{
+		//the run of keys with the same next character, at least one even if they are out of order
+		c = key_char(keys, start, depth);
+		low = start + 1;
+		high = end;
+		while(low < high)
+		{
+			mid = low + (high - low) / 2;
+			if(key_char(keys, mid, depth) <= c)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		group_end = low;
+
+		//one more character: delete it, insert a character of word, or match or change it
+		next_row[0] = row[0] + 1;
+		best = next_row[0];
+		for(j = 1; j <= len; j++)
+		{
+			next_row[j] = row[j] + 1;
+			if(next_row[j - 1] + 1 < next_row[j])
+				next_row[j] = next_row[j - 1] + 1;
+			if(row[j - 1] + ((unsigned char) word[j - 1] != c) < next_row[j])
+				next_row[j] = row[j - 1] + ((unsigned char) word[j - 1] != c);
+			if(next_row[j] < best)
+				best = next_row[j];
+		}
+
+		if(best <= max_edits)
+			fuzzy(keys, start, group_end, depth + 1, word, len, next_row, max_edits, matches);
+		start = group_end;
+	}
+	free(next_row);
+}
+
+static void start_matches(Matches* matches)
+{
+	matches->found = malloc(16 * sizeof(int));
+	matches->count = 0;
+	matches->size = 16;
+}
+
+static void add_match(Matches* matches, int found)
+{
+	if(matches->count == matches->size)
+	{
+		matches->size *= 2;
+		matches->found = realloc(matches->found, matches->size * sizeof(int));
+	}
+	matches->found[matches->count++] = found;
+}
+
+/* prints the computers of a list of keys, each computer once, in the order of the first of its
+ * keys in the list */
+static void fprint_matches(FILE* f, HostKeys* keys, Matches* matches, char* input)
+{
+	Matches computers;
+	uint64_t* places;
+	int* ids;
+	int* firsts;
+	int i, j, count, num_firsts = 0;
+
+	//every computer of each key in turn
+	start_matches(&computers);
+	for(i = 0; i < matches->count; i++)
+	{
+		count = keys->computers(keys->data, matches->found[i], &ids);
+		for(j = 0; j < count; j++)
+			add_match(&computers, ids[j]);
+	}
+
+	if(computers.count == 0)
+	{
+		fprintf(f, "no key %s\n\n", input);
+		free(computers.found);
+		return;
+	}
+
+	//sorted by computer then place in the list, the first of each computer is where it prints
+	places = malloc(computers.count * sizeof(uint64_t));
+	for(i = 0; i < computers.count; i++)
+		places[i] = ((uint64_t) (unsigned int) computers.found[i] << 32) | i;
+	qsort(places, computers.count, sizeof(uint64_t), compare_keys);
+
+	firsts = malloc(computers.count * sizeof(int));
+	for(i = 0; i < computers.count; i++)
+	{
+		if(i == 0 || (places[i] >> 32) != (places[i - 1] >> 32))
+			firsts[num_firsts++] = (int) (places[i] & 0xffffffff);
+	}
+	qsort(firsts, num_firsts, sizeof(int), compare_ints);
+
+	for(i = 0; i < num_firsts; i++)
+		keys->print(f, keys->data, computers.found[firsts[i]]);
+
+	free(computers.found);
+	free(places);
+	free(firsts);
+}
+
+static int compare_ints(const void* a, const void* b)
+{
+	int x = *(int*) a;
+	int y = *(int*) b;
+
+	if(x == y)
+		return 0;
+
+	return (x < y) ? -1 : 1;
+}
+
+//writes addr as a dotted quad without a '\0', returns how many characters that is
+static int format_ip(char* out, uint32_t addr)
+{
+	unsigned int octet;
+	int i, len = 0;
+
+	for(i = 24; i >= 0; i -= 8)
+	{
+		octet = (addr >> i) & 0xff;
+		if(octet >= 100)
+			out[len++] = '0' + octet / 100;
+		if(octet >= 10)
+			out[len++] = '0' + octet / 10 % 10;
+		out[len++] = '0' + octet % 10;
+		if(i > 0)
+			out[len++] = '.';
+	}
+
+	return len;
+}
+
+//reads a decimal number no bigger than max, returns where it ends or NULL if there isn't one
+static char* parse_number(char* s, unsigned int max, unsigned int* n)
+{
+	int digits = 0;
+
+	*n = 0;
+	while(*s >= '0' && *s <= '9' && digits < 4)
+	{
+		*n = *n * 10 + (*s++ - '0');
+		digits++;
+	}
+	if(digits == 0 || digits == 4 || *n > max)
+		return NULL;
+
+	return s;
+}
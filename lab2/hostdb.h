@@ -0,0 +1,123 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab2: hostdb.h
+ * The host database shared by l2p1, l2p2 and l2p3. Each program reads "converted" its own way and
+ * adds every computer and each of its names here, and the queries are answered from a hash table
+ * of names instead of by walking a tree of all of them. hostdb_map() loads "converted" by mapping
+ * it into memory, so names are never copied.
+ * Nothing is allocated per computer or per name: computers are numbered from 0 in the order they
+ * are added and kept in parallel arrays, names are kept in one array, and the bytes of the names
+ * are in one arena (or the mapping). Once it is loaded and hostdb_prepare() has been called the
+ * database is only read, so any number of threads can answer queries from it at once.
+ * 09/14/2020 */
+
+#ifndef HOSTDB_H
+#define HOSTDB_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//longest host name a query can have
+#define MAX_INPUT 1000
+
+//size of standard output's buffer in batch mode, so answers go out in a few big write()s
+#define OUTPUT_BUFFER (1 << 20)
+
+//most edits a fuzzy query ("name~2") can allow
+#define MAX_EDITS 3
+
+//socket l2srv listens on and l2client connects to, and the line that ends each answer l2srv sends
+#define SOCKET_NAME "l2p.sock"
+#define END_OF_ANSWER ".\n"
+
+/* one name of one computer: len bytes at off in the database's text. A local name is the start
+ * of the absolute name it came from, so it isn't '\0' terminated. next is the next name in the
+ * same hash bucket, or -1. Names that match are next to each other in their bucket, and last is
+ * the last of them for the first one, or -1 for the rest */
+typedef struct HostName
+{
+	long off;
+	int len;
+	unsigned int hash;
+	int computer;
+	int next;
+	int last;
+} HostName;
+
+/* addrs[id] is the address of computer id as one number (the first byte of its ip highest), and
+ * its names are names[first_name[id]] up to the first name of the next computer. A computer's
+ * names are in the order they print in, a local name right before the absolute name it is from.
+ * text is either arena, where the names of the computers read by the programs are copied, or the
+ * mapping of a file loaded with hostdb_map(). by_ip has the computers in order of address and
+ * by_name has the names in order of their bytes, both sorted the first time they're needed */
+typedef struct HostDB
+{
+	uint32_t* addrs;
+	int* first_name;
+	int num_computers;
+	int computers_size;
+
+	HostName* names;
+	int count;
+	int names_size;
+	int* buckets;
+	unsigned int size;
+
+	char* text;
+	char* arena;
+	long arena_used;
+	long arena_size;
+	char* map;
+	size_t map_size;
+
+	int* by_ip;
+	int by_ip_count;
+	int* by_name;
+	int by_name_count;
+} *HostDB;
+
+/* what hostkeys_answer() needs from a set of hosts, so the database and the index in hostidx.c
+ * parse queries and search names with the same code. Keys are names in order of their bytes (a
+ * shorter name first on a tie), computers are numbered by the set, and data is passed to each
+ * function */
+typedef struct HostKeys
+{
+	void* data;
+	//how many keys there are, sorting them first if they need it
+	int (*num_keys)(void* data);
+	//bytes of key i, false if they can't be read
+	bool (*key)(void* data, int i, char** name, int* len);
+	//sets *ids to the computers with key i and returns how many there are
+	int (*computers)(void* data, int i, int** ids);
+	//hostdb_range() of the set
+	int (*range)(void* data, uint32_t low, uint32_t high, int** ids);
+	//prints every computer with name, false if there are none
+	bool (*find)(FILE* f, void* data, char* name);
+	void (*print)(FILE* f, void* data, int computer);
+} HostKeys;
+
+HostDB make_hostdb();
+int hostdb_add_computer(HostDB db, unsigned char* header);
+void hostdb_add_name(HostDB db, char* name, int len);
+bool hostdb_map(HostDB db, char* path);
+bool hostdb_read(HostDB db, char* path);
+int hostdb_find(HostDB db, char* name);
+int hostdb_next(HostDB db, int name);
+int hostdb_num_names(HostDB db, int computer);
+void hostdb_prepare(HostDB db);
+int hostdb_range(HostDB db, uint32_t low, uint32_t high, int** first);
+int hostdb_prefix(HostDB db, char* prefix, int** first);
+int hostdb_fuzzy(HostDB db, char* word, int max_edits, int** found);
+int compare_names(char* a, int a_len, char* b, int b_len);
+bool parse_cidr(char* s, uint32_t* low, uint32_t* high);
+void print_computer(HostDB db, int computer);
+void fprint_computer(FILE* f, HostDB db, int computer);
+void hostdb_answer(FILE* f, HostDB db, char* input);
+void hostdb_query(HostDB db, bool batch);
+void hostkeys_answer(FILE* f, HostKeys* keys, char* input);
+void hostkeys_query(HostKeys* keys, bool batch);
+void buffer_output();
+void free_hostdb(HostDB db);
+
+#endif
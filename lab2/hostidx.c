@@ -0,0 +1,354 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab2: hostidx.c
+ * Implementation of the host index in hostidx.h. An index file is
+ *   IdxHeader
+ *   IdxKey[keys]            every distinct name, sorted by its bytes (a shorter name first on a tie)
+ *   uint32_t[lists]         computer ids, each key's run in the order the computers were read
+ *   IdxComputer[computers]  by id
+ *   uint32_t[computers]     computer ids sorted by address, then by id
+ *   blob_size bytes         the names and the printed computers the tables point into
+ * in native byte order, so it is used as it is mapped: opening it checks only the header, and a
+ * query is a binary search over the keys (or the addresses) and one fwrite() per computer. Offsets are checked as
+ * they are used, so a damaged index gives wrong answers instead of reading outside the mapping.
+ * The keys are sorted like hostdb's by_name, so hostidx_query() hands them to hostkeys_query() and
+ * the queries are parsed and searched by the same code as hostdb's, only reading names and
+ * printing computers here.
+ * 09/14/2020 */
+
+#include "hostidx.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+static bool valid_key(HostIdx idx, IdxKey* key);
+static int idx_num_keys(void* data);
+static bool idx_key(void* data, int i, char** name, int* len);
+static int idx_computers(void* data, int i, int** ids);
+static int idx_range(void* data, uint32_t low, uint32_t high, int** ids);
+static bool idx_find(FILE* f, void* data, char* name);
+static void idx_print(FILE* f, void* data, int computer);
+static uint32_t addr_of(HostIdx idx, uint32_t id);
+
+/* writes an index of every name in db to path, through a temporary file that is renamed over it.
+ * Returns false with errno set if it can't be written */
+bool hostidx_write(HostDB db, char* path)
+{
+	IdxHeader header;
+	IdxKey* keys;
+	uint32_t* lists;
+	IdxComputer* computers;
+	int* sorted;
+	int* by_ip;
+	HostName* entry;
+	HostName* prev;
+	FILE* b;
+	FILE* f;
+	char* blob;
+	size_t blob_size;
+	char* tmp_path;
+	unsigned int i, n = db->count, num_keys = 0;
+	bool ok;
+
+	//all names sorted, names that match stay in the order they were added
+	hostdb_prepare(db);
+	sorted = db->by_name;
+
+	//a key for each run of the same name, with the name written once to the blob
+	b = open_memstream(&blob, &blob_size);
+	keys = malloc((n + 1) * sizeof(IdxKey));
+	lists = malloc((n + 1) * sizeof(uint32_t));
+	for(i = 0; i < n; i++)
+	{
+		entry = &db->names[sorted[i]];
+		prev = (i > 0) ? &db->names[sorted[i - 1]] : NULL;
+		if(prev == NULL || compare_names(db->text + entry->off, entry->len, db->text + prev->off, prev->len) != 0)
+		{
+			keys[num_keys].name = ftell(b);
+			keys[num_keys].len = entry->len;
+			keys[num_keys].list = i;
+			keys[num_keys].count = 0;
+			fwrite(db->text + entry->off, 1, entry->len, b);
+			num_keys++;
+		}
+		keys[num_keys - 1].count++;
+		lists[i] = entry->computer;
+	}
+
+	//each computer exactly as print_computer() would print it
+	computers = malloc((db->num_computers + 1) * sizeof(IdxComputer));
+	for(i = 0; i < (unsigned int) db->num_computers; i++)
+	{
+		computers[i].text = ftell(b);
+		fprint_computer(b, db, i);
+		computers[i].len = ftell(b) - computers[i].text;
+		computers[i].addr = db->addrs[i];
+	}
+	fclose(b);
+
+	//every computer is in the range of all addresses, already in address order
+	hostdb_range(db, 0, UINT32_MAX, &by_ip);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, IDX_MAGIC, sizeof(header.magic));
+	header.order = IDX_ORDER;
+	header.keys = num_keys;
+	header.lists = n;
+	header.computers = db->num_computers;
+	header.blob_size = blob_size;
+
+	//offsets are 32 bits
+	ok = (blob_size <= UINT32_MAX);
+	if(!ok)
+		errno = EFBIG;
+
+	tmp_path = malloc(strlen(path) + 32);
+	sprintf(tmp_path, "%s.tmp%d", path, getpid());
+	f = ok ? fopen(tmp_path, "w") : NULL;
+	if(f != NULL)
+	{
+		fwrite(&header, sizeof(header), 1, f);
+		fwrite(keys, sizeof(IdxKey), num_keys, f);
+		fwrite(lists, sizeof(uint32_t), n, f);
+		fwrite(computers, sizeof(IdxComputer), db->num_computers, f);
+		fwrite(by_ip, sizeof(int), db->num_computers, f);
+		fwrite(blob, 1, blob_size, f);
+		ok = (ferror(f) == 0);
+		if(fclose(f) != 0)
+			ok = false;
+		if(ok)
+			ok = (rename(tmp_path, path) == 0);
+		if(!ok)
+			unlink(tmp_path);
+	}
+	else
+		ok = false;
+
+	free(tmp_path);
+	free(keys);
+	free(lists);
+	free(computers);
+	free(blob);
+
+	return ok;
+}
+
+/* maps an index written by hostidx_write(). Returns NULL with errno set if it can't be opened, or
+ * with errno EINVAL if it isn't an index or its tables don't fit the file */
+HostIdx hostidx_open(char* path)
+{
+	HostIdx idx;
+	IdxHeader* header;
+	struct stat fileStat;
+	unsigned long expected;
+	char* map;
+	int f;
+
+	f = open(path, O_RDONLY);
+	if(f < 0)
+		return NULL;
+	if(fstat(f, &fileStat) < 0)
+	{
+		close(f);
+		return NULL;
+	}
+	if(fileStat.st_size < (off_t) sizeof(IdxHeader))
+	{
+		close(f);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	map = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+	close(f);
+	if(map == MAP_FAILED)
+		return NULL;
+
+	header = (IdxHeader*) map;
+	expected = sizeof(IdxHeader) + (unsigned long) header->keys * sizeof(IdxKey)
+		+ (unsigned long) header->lists * sizeof(uint32_t)
+		+ (unsigned long) header->computers * (sizeof(IdxComputer) + sizeof(uint32_t)) + header->blob_size;
+	if(memcmp(header->magic, IDX_MAGIC, sizeof(header->magic)) != 0 || header->order != IDX_ORDER
+		|| expected != (unsigned long) fileStat.st_size)
+	{
+		munmap(map, fileStat.st_size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	idx = malloc(sizeof(struct HostIdx));
+	idx->map = map;
+	idx->map_size = fileStat.st_size;
+	idx->header = header;
+	idx->keys = (IdxKey*) (map + sizeof(IdxHeader));
+	idx->lists = (uint32_t*) (idx->keys + header->keys);
+	idx->computers = (IdxComputer*) (idx->lists + header->lists);
+	idx->by_ip = (uint32_t*) (idx->computers + header->computers);
+	idx->blob = (char*) (idx->by_ip + header->computers);
+
+	return idx;
+}
+
+//key for name, or NULL if no computer has it
+IdxKey* hostidx_find(HostIdx idx, char* name)
+{
+	unsigned int len = strlen(name);
+	uint32_t low = 0, high = idx->header->keys, mid;
+	IdxKey* key;
+	int cmp;
+
+	while(low < high)
+	{
+		mid = low + (high - low) / 2;
+		key = &idx->keys[mid];
+		if(!valid_key(idx, key))
+			return NULL;
+
+		cmp = compare_names(idx->blob + key->name, key->len, name, len);
+		if(cmp == 0)
+			return key;
+		if(cmp < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return NULL;
+}
+
+/* hostdb_range() in the index: *first is set to the first of the ids of the computers with
+ * addresses from low to high, and the number of them is returned */
+uint32_t hostidx_range(HostIdx idx, uint32_t low, uint32_t high, uint32_t** first)
+{
+	uint32_t start = 0, end = idx->header->computers, mid;
+
+	while(start < end)
+	{
+		mid = start + (end - start) / 2;
+		if(addr_of(idx, idx->by_ip[mid]) < low)
+			start = mid + 1;
+		else
+			end = mid;
+	}
+
+	*first = idx->by_ip + start;
+	for(end = start; end < idx->header->computers && addr_of(idx, idx->by_ip[end]) <= high; end++);
+
+	return end - start;
+}
+
+//hostdb_query() answered from the index
+void hostidx_query(HostIdx idx, bool batch)
+{
+	HostKeys keys;
+
+	keys.data = idx;
+	keys.num_keys = idx_num_keys;
+	keys.key = idx_key;
+	keys.computers = idx_computers;
+	keys.range = idx_range;
+	keys.find = idx_find;
+	keys.print = idx_print;
+
+	hostkeys_query(&keys, batch);
+}
+
+void hostidx_close(HostIdx idx)
+{
+	munmap(idx->map, idx->map_size);
+	free(idx);
+}
+
+//true if a key's name and its run of computer ids are inside the index
+static bool valid_key(HostIdx idx, IdxKey* key)
+{
+	return key->name <= idx->header->blob_size && key->len <= idx->header->blob_size - key->name
+		&& key->list <= idx->header->lists && key->count <= idx->header->lists - key->list;
+}
+
+static int idx_num_keys(void* data)
+{
+	return ((HostIdx) data)->header->keys;
+}
+
+//a damaged key can't be read
+static bool idx_key(void* data, int i, char** name, int* len)
+{
+	HostIdx idx = data;
+	IdxKey* key = &idx->keys[i];
+
+	if(!valid_key(idx, key))
+		return false;
+	*name = idx->blob + key->name;
+	*len = key->len;
+
+	return true;
+}
+
+//a damaged key has no computers
+static int idx_computers(void* data, int i, int** ids)
+{
+	HostIdx idx = data;
+	IdxKey* key = &idx->keys[i];
+
+	if(!valid_key(idx, key))
+		return 0;
+	*ids = (int*) (idx->lists + key->list);
+
+	return key->count;
+}
+
+static int idx_range(void* data, uint32_t low, uint32_t high, int** ids)
+{
+	uint32_t* first;
+	uint32_t count = hostidx_range(data, low, high, &first);
+
+	*ids = (int*) first;
+
+	return count;
+}
+
+static bool idx_find(FILE* f, void* data, char* name)
+{
+	HostIdx idx = data;
+	IdxKey* key = hostidx_find(idx, name);
+	uint32_t i;
+
+	if(key == NULL)
+		return false;
+	for(i = 0; i < key->count; i++)
+		idx_print(f, idx, idx->lists[key->list + i]);
+
+	return true;
+}
+
+//address of a computer, a damaged id sorts after every address
+static uint32_t addr_of(HostIdx idx, uint32_t id)
+{
+	if(id >= idx->header->computers)
+		return UINT32_MAX;
+
+	return idx->computers[id].addr;
+}
+
+//the computer as print_computer() printed it, nothing for a damaged one
+static void idx_print(FILE* f, void* data, int computer)
+{
+	HostIdx idx = data;
+	uint32_t id = computer;
+	IdxComputer* entry;
+
+	if(id >= idx->header->computers)
+		return;
+	entry = &idx->computers[id];
+	if(entry->text > idx->header->blob_size || entry->len > idx->header->blob_size - entry->text)
+		return;
+
+	fwrite(idx->blob + entry->text, 1, entry->len, f);
+}
@@ -0,0 +1,72 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab2: hostidx.h
+ * Prebuilt index of the host database. l2idx loads "converted" once and writes everything the
+ * queries need, already sorted and formatted, to "converted.idx". l2p5 maps the index and answers
+ * straight from it, so it starts in the same time however big the database is. See hostidx.c for
+ * the file format.
+ * 09/14/2020 */
+
+#ifndef HOSTIDX_H
+#define HOSTIDX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hostdb.h"
+
+#define IDX_MAGIC "l2idx2\n"
+
+//written as 0x01020304, so an index from a machine with the other byte order is rejected
+#define IDX_ORDER 0x01020304
+
+/* start of the file. Every offset in the index is a uint32_t, and the tables and blob follow the
+ * header in this order */
+typedef struct IdxHeader
+{
+	char magic[8];
+	uint32_t order;
+	uint32_t keys;
+	uint32_t lists;
+	uint32_t computers;
+	uint32_t blob_size;
+	uint32_t unused;
+} IdxHeader;
+
+/* one name. Its len bytes start at name in the blob, and the ids of the count computers that have
+ * it start at list in the list table */
+typedef struct IdxKey
+{
+	uint32_t name;
+	uint32_t len;
+	uint32_t list;
+	uint32_t count;
+} IdxKey;
+
+//what print_computer() prints for a computer, len bytes at text in the blob, and its address
+typedef struct IdxComputer
+{
+	uint32_t text;
+	uint32_t len;
+	uint32_t addr;
+} IdxComputer;
+
+typedef struct HostIdx
+{
+	char* map;
+	size_t map_size;
+	IdxHeader* header;
+	IdxKey* keys;
+	uint32_t* lists;
+	IdxComputer* computers;
+	uint32_t* by_ip;
+	char* blob;
+} *HostIdx;
+
+bool hostidx_write(HostDB db, char* path);
+HostIdx hostidx_open(char* path);
+IdxKey* hostidx_find(HostIdx idx, char* name);
+uint32_t hostidx_range(HostIdx idx, uint32_t low, uint32_t high, uint32_t** first);
+void hostidx_query(HostIdx idx, bool batch);
+void hostidx_close(HostIdx idx);
+
+#endif
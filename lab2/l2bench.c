@@ -0,0 +1,195 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab2: l2bench.c
+ * This program times the lab2 programs against the "converted" and "queries" in the
+ * current directory (see l2gen). Each program is run with -b, once with no queries, which
+ * is just loading, and right after that once with every query, and the difference between the
+ * two runs of a pair is the time spent answering. For each it reports the best load time of a
+ * few pairs, the median of their query times (never below 0, since the noise in two runs can be
+ * bigger than the time spent answering), how many read() and write() calls the fastest run with
+ * queries made (from /proc/<pid>/io, read before the program is reaped) and its peak resident
+ * size.
+ * usage: l2bench [-r runs] [-q queries] program...
+ * 09/14/2020 */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+typedef struct Result
+{
+	double wall;
+	long reads;
+	long writes;
+	long peak_kb;
+} Result;
+
+static bool run(char* program, char* input, Result* result);
+static void read_io(pid_t pid, Result* result);
+static bool measure(char* program, char* queries, int runs, Result* load, Result* all, double* query);
+static int compare_doubles(const void* a, const void* b);
+
+int main(int argc, char** argv)
+{
+	char* queries = "queries";
+	int runs = 3;
+	int i = 1;
+	Result load, all;
+	double query;
+
+	while(i + 1 < argc && argv[i][0] == '-')
+	{
+		if(strcmp(argv[i], "-r") == 0)
+			runs = atoi(argv[i + 1]);
+		else if(strcmp(argv[i], "-q") == 0)
+			queries = argv[i + 1];
+		else
+			break;
+		i += 2;
+	}
+	if(i >= argc || runs < 1)
+	{
+		fprintf(stderr, "usage: l2bench [-r runs] [-q queries] program...\n");
+		return 1;
+	}
+	if(access(queries, R_OK) < 0)
+	{
+		perror(queries);
+		return 1;
+	}
+
+	printf("%-16s %10s %10s %12s %10s %10s\n", "program", "load s", "query s", "read()s", "write()s", "peak MB");
+	for(; i < argc; i++)
+	{
+		if(!measure(argv[i], queries, runs, &load, &all, &query))
+		{
+			printf("%-16s failed\n", argv[i]);
+			continue;
+		}
+		printf("%-16s %10.3f %10.3f %12ld %10ld %10.1f\n", argv[i], load.wall, query,
+			all.reads, all.writes, all.peak_kb / 1024.0);
+		fflush(stdout);
+	}
+
+	return 0;
+}
+
+/* runs a program with no queries and then with queries, runs times. load and all are the fastest
+ * run of each, and query is the median of the time each pair's run with queries took over its run
+ * without them. False if any run failed */
+static bool measure(char* program, char* queries, int runs, Result* load, Result* all, double* query)
+{
+	Result empty, full;
+	double* diffs = malloc(runs * sizeof(double));
+	int i;
+
+	for(i = 0; i < runs; i++)
+	{
+		if(!run(program, "/dev/null", &empty) || !run(program, queries, &full))
+		{
+			free(diffs);
+			return false;
+		}
+		if(i == 0 || empty.wall < load->wall)
+			*load = empty;
+		if(i == 0 || full.wall < all->wall)
+			*all = full;
+		diffs[i] = full.wall - empty.wall;
+	}
+
+	qsort(diffs, runs, sizeof(double), compare_doubles);
+	*query = (runs % 2 == 1) ? diffs[runs / 2] : (diffs[runs / 2 - 1] + diffs[runs / 2]) / 2;
+	if(*query < 0)
+		*query = 0;
+	free(diffs);
+
+	return true;
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+	double x = *(double*) a, y = *(double*) b;
+
+	return (x > y) - (x < y);
+}
+
+//runs program -b with input as standard input and its output thrown away, false if it didn't exit 0
+static bool run(char* program, char* input, Result* result)
+{
+	struct timespec start, end;
+	struct rusage usage;
+	siginfo_t info;
+	pid_t pid;
+	int status, in, out;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid = fork();
+	if(pid < 0)
+	{
+		perror("fork");
+		return false;
+	}
+	if(pid == 0)
+	{
+		in = open(input, O_RDONLY);
+		out = open("/dev/null", O_WRONLY);
+		if(in < 0 || out < 0)
+			_exit(127);
+		dup2(in, 0);
+		dup2(out, 1);
+		close(in);
+		close(out);
+		execl(program, program, "-b", (char*) NULL);
+		perror(program);
+		_exit(127);
+	}
+
+	//the program has exited but isn't reaped yet, so its /proc entry is still there
+	if(waitid(P_PID, pid, &info, WEXITED | WNOWAIT) < 0)
+	{
+		perror("waitid");
+		return false;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	read_io(pid, result);
+
+	if(wait4(pid, &status, 0, &usage) < 0)
+	{
+		perror("wait4");
+		return false;
+	}
+
+	result->wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	result->peak_kb = usage.ru_maxrss;
+
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+//read and write system call counts of a process, -1 if they can't be read
+static void read_io(pid_t pid, Result* result)
+{
+	char path[64];
+	char line[256];
+	FILE* f;
+
+	result->reads = -1;
+	result->writes = -1;
+
+	sprintf(path, "/proc/%d/io", (int) pid);
+	f = fopen(path, "r");
+	if(f == NULL)
+		return;
+	while(fgets(line, sizeof(line), f) != NULL)
+	{
+		sscanf(line, "syscr: %ld", &result->reads);
+		sscanf(line, "syscw: %ld", &result->writes);
+	}
+	fclose(f);
+}
@@ -0,0 +1,94 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab2: l2client.c
+ * This program asks l2srv for the same answers l2p1 through l2p5 give, so it doesn't
+ * load the database at all. It connects to "l2p.sock", or the socket given as its last
+ * argument, and the user is then allowed to search through the database repeatedly, or
+ * with -b names are read from standard input without prompts.
+ * 09/14/2020 */
+
+#include "hostdb.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+int main(int argc, char** argv)
+{
+	//-b answers names from standard input without prompting
+	bool batch = (argc > 1 && strcmp(argv[1], "-b") == 0);
+	char* path = (argc > 1 + batch) ? argv[1 + batch] : SOCKET_NAME;
+
+	char input[MAX_INPUT + 1];
+	struct sockaddr_un addr;
+	FILE* to;
+	FILE* from;
+	char* line = NULL;
+	size_t size = 0;
+	bool answered;
+	int f;
+
+	if(strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "%s: socket path is too long\n", path);
+		return 1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	f = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(f < 0 || connect(f, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+	{
+		perror(path);
+		fprintf(stderr, "is l2srv running?\n");
+		return 1;
+	}
+	to = fdopen(f, "w");
+	from = fdopen(dup(f), "r");
+
+	if(!batch)
+		printf("Hosts all read in\n\n");
+	else
+		buffer_output();
+
+	//prompt continuously until EOF
+	while(1)
+	{
+		if(!batch)
+			printf("Enter host name: ");
+
+		if(scanf("%1000s", input) == EOF)
+			break;
+
+		fprintf(to, "%s\n", input);
+		fflush(to);
+
+		//the answer is everything up to the line that ends it
+		answered = false;
+		while(getline(&line, &size, from) >= 0)
+		{
+			if(strcmp(line, END_OF_ANSWER) == 0)
+			{
+				answered = true;
+				break;
+			}
+			fputs(line, stdout);
+		}
+		if(!answered)
+		{
+			fprintf(stderr, "%s: l2srv hung up\n", path);
+			return 1;
+		}
+	}
+
+	free(line);
+	fclose(to);
+	fclose(from);
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab2: l2gen.c
+ * This program writes a synthetic "converted" of any number of hosts, for timing the
+ * other programs at sizes the class's file doesn't reach, and a file "queries" of names
+ * to look up in it. Each host has a random ip and one to three names, most of them
+ * absolute (with a domain), and the queries are names picked evenly from the file, with a
+ * third of the absolute ones asked for by their local name (about a fifth of all queries,
+ * since 60% of names are absolute), plus a couple that aren't in it. The same hosts and
+ * seed always give the same files.
+ * usage: l2gen hosts [queries [seed]], 100000 queries by default
+ * 09/14/2020 */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define MAX_NAME 64
+
+static char* words[] = {"alpha", "beta", "gamma", "delta", "eps", "zeta", "eta", "theta", "iota", "kappa", "lambda", "mu"};
+static char* domains[] = {"cs.utk.edu", "eecs.utk.edu", "math.utk.edu"};
+
+static uint64_t state;
+
+//xorshift64*, so files are the same on every machine
+static uint64_t next_random()
+{
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+
+	return state * 2685821657736338717UL;
+}
+
+static long random_below(long n)
+{
+	return (long) (next_random() % (uint64_t) n);
+}
+
+int main(int argc, char** argv)
+{
+	FILE* converted;
+	FILE* queries;
+	char** picked;
+	char name[MAX_NAME];
+	unsigned char header[8];
+	long hosts, num_queries, seen = 0, h, slot;
+	int i, j, names, len;
+	char* dot;
+
+	if(argc < 2 || argc > 4 || (hosts = atol(argv[1])) <= 0)
+	{
+		fprintf(stderr, "usage: l2gen hosts [queries [seed]]\n");
+		return 1;
+	}
+	num_queries = (argc > 2) ? atol(argv[2]) : 100000;
+	state = (argc > 3) ? strtoull(argv[3], NULL, 10) * 2 + 1 : 1;
+	if(num_queries < 0)
+		num_queries = 0;
+
+	converted = fopen("converted", "w");
+	if(converted == NULL)
+	{
+		perror("converted");
+		return 1;
+	}
+
+	//queries are a reservoir sample of every name written
+	picked = calloc(num_queries + 1, sizeof(char*));
+
+	for(h = 0; h < hosts; h++)
+	{
+		names = 1 + random_below(3);
+		for(i = 0; i < 4; i++)
+			header[i] = random_below(256);
+		header[4] = 0;
+		header[5] = 0;
+		header[6] = 0;
+		header[7] = names;
+		fwrite(header, 1, 8, converted);
+
+		for(j = 0; j < names; j++)
+		{
+			len = sprintf(name, "%s%ld", words[random_below(12)], random_below(hosts / 2 + 1));
+			if(random_below(10) < 6)
+				len += sprintf(name + len, ".%s", domains[random_below(3)]);
+			fwrite(name, 1, len + 1, converted);
+
+			seen++;
+			slot = (seen <= num_queries) ? seen - 1 : random_below(seen);
+			if(slot < num_queries)
+			{
+				free(picked[slot]);
+				picked[slot] = strdup(name);
+			}
+		}
+	}
+
+	if(fclose(converted) != 0)
+	{
+		perror("converted");
+		return 1;
+	}
+
+	queries = fopen("queries", "w");
+	if(queries == NULL)
+	{
+		perror("queries");
+		return 1;
+	}
+	for(i = 0; i < num_queries && picked[i] != NULL; i++)
+	{
+		//a third of the absolute names are asked for by their local name
+		dot = strchr(picked[i], '.');
+		if(dot != NULL && random_below(3) == 0)
+			*dot = '\0';
+		fprintf(queries, "%s\n", picked[i]);
+		free(picked[i]);
+	}
+	fprintf(queries, "nosuch\nx.y\n");
+	fclose(queries);
+	free(picked);
+
+	return 0;
+}
@@ -0,0 +1,46 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab2: l2idx.c
+ * This program reads a file "converted" that represents a list of ip addresses and
+ * associated names and compiles it into an index, "converted.idx" (see hostidx.c), that
+ * l2p5 can answer queries from without reading "converted" at all. Another file can be
+ * given as the first argument, and another index as the second.
+ * 09/14/2020 */
+
+#include "hostdb.h"
+#include "hostidx.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+int main(int argc, char** argv)
+{
+	HostDB db = make_hostdb();
+	char* input = (argc > 1) ? argv[1] : "converted";
+	char* output = (argc > 2) ? argv[2] : "converted.idx";
+
+	if(argc > 3)
+	{
+		fprintf(stderr, "usage: l2idx [converted [index]]\n");
+		return 1;
+	}
+
+	if(!hostdb_map(db, input))
+	{
+		perror(input);
+		free_hostdb(db);
+		return 1;
+	}
+
+	if(!hostidx_write(db, output))
+	{
+		perror(output);
+		free_hostdb(db);
+		return 1;
+	}
+
+	free_hostdb(db);
+
+	return 0;
+}
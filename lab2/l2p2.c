@@ -3,14 +3,14 @@
  * Lab2: l2p2.c
  * This program reads a stream of bytes from a file "converted" that represents a
  * list of ip addresses and associated names, translates the bytes, and stores the
- * data in a red-black tree. The user is then allowed to search through the database
- * repeatedly. This version uses system calls such as open, read, close, etc. without
- * a buffer.
+ * data in a hash table (see hostdb.c). The user is then allowed to search through the
+ * database repeatedly, or with -b names are read from standard input without
+ * prompts. This version uses system calls such as open, read, close, etc. without
+ * a buffer: names are read a byte at a time, but in a single pass that copies each byte
+ * once and never seeks back.
  * 09/14/2020 */
 
-#include "jval.h"
-#include "jrb.h"
-#include "dllist.h"
+#include "hostdb.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,203 +20,63 @@
 #include <unistd.h>
 #include <fcntl.h>
 
-typedef struct Computer 
-{
-	unsigned char* ip;
-	int num_names;
-	Dllist names;
-} *Computer;
-
-int main()
+int main(int argc, char** argv)
 {
 	int f = open("converted", O_RDONLY);
-	JRB all_names = make_jrb();
+	HostDB db = make_hostdb();
+
+	//-b answers names from standard input without prompting
+	bool batch = (argc > 1 && strcmp(argv[1], "-b") == 0);
 	
-	int i, j;
+	int i, names;
 	char c;
-	unsigned char* ip = malloc(4);
-	
-	//find all ip addresses with associated names
-	while(read(f, &c, 1) != 0)
-	{
-		//create new computer struct with malloc
-		int names = 0;
-		Computer computer = malloc(sizeof(struct Computer));
-		computer->ip = malloc(4);	
-		computer->names = new_dllist();
-
-		//get 4 bytes of ip
-		computer->ip[0] = c;
+	unsigned char header[8];
 
-		for(i = 1; i < 4; i++)
-		{	
-			read(f, &c, 1);
-			computer->ip[i] = c;
-		}
-		
-		//get 4 bytes of int
-		char* hold_int = malloc(4);
-
-		for(i = 0; i < 4; i++)
-		{	
-			read(f, &c, 1);
-			hold_int[i] = c;
-		}
+	//the name being read goes into buf, which doubles when it fills up and is reused for every name
+	int buf_size = 64;
+	char* buf = malloc(buf_size);
+	int len;
+	ssize_t got = 1;
 	
-		//convert unsigned chars into int with bitshifting
-		for(i = 0; i < 4; i++)
-		{		
-			//"copy" 8 bits from chars, then move 8 to the left to copy next part
-			names |= hold_int[i];
-			if(i != 3)
-				names <<= 8;
-		}
-
-		computer->num_names = names;
-		free(hold_int);
+	//find all ip addresses with associated names, each record starts with 4 bytes of ip and 4 bytes of int
+	while(got == 1 && read(f, header, 8) == 8)
+	{
+		names = hostdb_add_computer(db, header);
 
 		//get each name
 		for(i = 0; i < names; i++)
 		{
-			int name_size = 0;
-			//save where beginning of current name is
-			long name_beg = lseek(f, 0, SEEK_CUR);
-
-			//if current name is an absolute name, these are for saving the prefix as local name		
-			int prefix_size = 0;
-			bool need_prefix = false;
-			long dot_mark = -1;
-			char* prefix_name;
-			
-			//count size of name (and maybe prefix name) to malloc correctly
-			while(1)
+			//one byte at a time until the '\0', which is kept
+			len = 0;
+			while((got = read(f, &c, 1)) == 1)
 			{
-				read(f, &c, 1);
-				name_size++;
-				//if '.' is found then this name is an absolute name; set flag to save prefix
-				if(c == '.' && dot_mark == -1)
-				{	
-					prefix_size = name_size;
-					prefix_name = malloc(prefix_size);
-					need_prefix = true;
-					dot_mark = lseek(f, 0, SEEK_CUR);		
-				}
-				if(c == '\0')
-					break;
-			}
-
-			char* new_name = malloc(name_size);
-
-			lseek(f, name_beg, SEEK_SET);
-
-			for(j = 0;; j++)
-			{
-				read(f, &c, 1);
-				new_name[j] = c;
-				
-				//if prefix needs to be saved, this is where separate creation of local name happens alongside absolute name
-				if(lseek(f, 0, SEEK_CUR) <= dot_mark)
+				if(len == buf_size)
 				{
-					prefix_name[j] = c;
-					//end of prefix has been reached, insert '\0' instead of '.' and finish prefix name
-					if(lseek(f, 0, SEEK_CUR) == dot_mark)
-					{
-						prefix_name[j] = '\0';
-						jrb_insert_str(all_names, prefix_name, new_jval_v(computer));
-						dll_append(computer->names, new_jval_s(prefix_name));
-					}
+					buf_size *= 2;
+					buf = realloc(buf, buf_size);
 				}
-				
+				buf[len++] = c;
 				if(c == '\0')
 					break;
 			}
 
-			jrb_insert_str(all_names, new_name, new_jval_v(computer));
-			dll_append(computer->names, new_jval_s(new_name));
-		}
-	}
-
-	//begin user input
-
-	char* input = malloc(100);
-	JRB find_node;
-	JRB found;
-	Dllist print;
-	
-	printf("Hosts all read in\n\n");
-	
-	//prompt continuously until EOF
-	while(1)
-	{
-		printf("Enter host name: ");
-
-		if(scanf("%s", input) == EOF)
-			break;
-	
-		find_node = jrb_find_str(all_names, input);
-
-		//if name exists, print ip and all names
-		if(find_node != NULL)
-		{
-			jrb_traverse(found, all_names)
-			{
-				if(strcmp(input, found->key.s) == 0)
-				{
-					//print ip
-					for(i = 0; i < 4; i++)
-					{
-						printf("%d", ((Computer)(found->val.v))->ip[i]);
-						if(i < 3)
-							printf(".");
-					}
-					printf(": ");
+			//a name cut off by EOF ends the file
+			if(got != 1)
+				break;
 
-					//print names
-					dll_traverse(print, ((Computer)(found->val.v))->names)
-					{
-						printf("%s ", print->val.s);
-					}
-					printf("\n\n");
-				}
-			}
+			//hostdb_add_name() copies it into the database, and makes the local name from it too
+			hostdb_add_name(db, buf, len - 1);
 		}
-		else
-			printf("no key %s\n\n", input);
 	}
-	
-	//memory management
-	
-	JRB delete;
-	Dllist node;
 
-	//traverse entire tree
-	jrb_traverse(delete, all_names)
-	{
-		Computer comp = (Computer)(delete->val.v);
+	free(buf);
 
-		//reduce num_names by one to mark as visited, when 0 all names have been visited and computer pointer can be entirely freed
-		comp->num_names--;
-		if(comp->num_names == 0)
-		{
-			//free names in dllist
-			dll_traverse(node, comp->names)
-			{
-				free(node->val.s);
-			}
-			free_dllist(comp->names);
-			//free member variables
-			free(comp->ip);
-			free(comp);
-		}
-	}
-
-	jrb_free_tree(all_names);
+	//begin user input, then free the database
+	hostdb_query(db, batch);
+	free_hostdb(db);
 	
-	//free misc memory and close file
+	//close file
 	close(f);
-	
-	free(input);
-	free(ip);
 
 	return 0;
 }
@@ -3,14 +3,13 @@
  * Lab2: l2p3.c
  * This program reads a stream of bytes from a file "converted" that represents a
  * list of ip addresses and associated names, translates the bytes, and stores the
- * data in a red-black tree. The user is then allowed to search through the database
- * repeatedly. This version uses system calls such as open, read, close, etc. with
- * a buffer.
+ * data in a hash table (see hostdb.c). The user is then allowed to search through the
+ * database repeatedly, or with -b names are read from standard input without
+ * prompts. This version uses system calls such as open, read, close, etc. with
+ * a buffer. Names are found in the buffer with memchr() and copied out with memcpy().
  * 09/14/2020 */
 
-#include "jval.h"
-#include "jrb.h"
-#include "dllist.h"
+#include "hostdb.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,216 +19,66 @@
 #include <unistd.h>
 #include <fcntl.h>
 
-typedef struct Computer 
-{
-	unsigned char* ip;
-	int num_names;
-	Dllist names;
-} *Computer;
-
-int main()
+int main(int argc, char** argv)
 {
 	int f = open("converted", O_RDONLY);
-	JRB all_names = make_jrb();
+	HostDB db = make_hostdb();
+
+	//-b answers names from standard input without prompting
+	bool batch = (argc > 1 && strcmp(argv[1], "-b") == 0);
 	
-	int i, j;
-	unsigned char* c = malloc(350000);
-	unsigned char* ip = malloc(4);
+	int i, names;
+	struct stat fileStat;
+	unsigned char* c;
+	unsigned char* end;
+	int len;
 	
-	//copy entire file into buffer c, returned is the number of bytes in the file
-	int returned = read(f, c, 350000);
+	//buffer c is as big as the file, so a file of any size is read in whole
+	fstat(f, &fileStat);
+	c = malloc(fileStat.st_size + 1);
+
+	//copy entire file into buffer c, returned is the number of bytes in the file. read() can return less than asked, so keep going until EOF
+	int returned = 0;
+	int got;
+	while(returned < fileStat.st_size && (got = read(f, c + returned, fileStat.st_size - returned)) > 0)
+		returned += got;
 	
 	//can be closed here because buffer contains the file
 	close(f);
 
 	int pos = 0;
+	bool cut = false;
 
-	//find all ip addresses with associated names
-	while(pos < returned)
+	//find all ip addresses with associated names, each record starts with 4 bytes of ip and 4 bytes of int
+	while(!cut && returned - pos >= 8)
 	{
-		//create new computer struct with malloc
-		int names = 0;
-		Computer computer = malloc(sizeof(struct Computer));
-		computer->ip = malloc(4);	
-		computer->names = new_dllist();
-
-		//pos is the position in the file
-		//this version of the program goes byte by byte like fgetc by incrementing pos by 1 each time a "read" would be done. To check without moving, pos + 1 instead of pos++
-		
-		//get 4 bytes of ip
-		computer->ip[0] = c[pos];
-		pos++;
-		
-		for(i = 1; i < 4; i++)
-		{	
-			computer->ip[i] = c[pos];
-			pos++;
-		}
-		
-		//get 4 bytes of int
-		char* hold_int = malloc(4);
-
-		for(i = 0; i < 4; i++)
-		{	
-			hold_int[i] = c[pos];
-			pos++;
-		}
-		
-		//convert unsigned chars into int with bitshifting
-		for(i = 0; i < 4; i++)
-		{		
-			//"copy" 8 bits from chars, then move 8 to the left to copy next part
-			names |= hold_int[i];
-			if(i != 3)
-				names <<= 8;
-		}
-
-		computer->num_names = names;
-		free(hold_int);
+		names = hostdb_add_computer(db, c + pos);
+		pos += 8;
 
-		//get each name
+		//get each name, memchr() finds its '\0' and the whole name is copied in one go
 		for(i = 0; i < names; i++)
 		{
-			int name_size = 0;
-			//save where beginning of current name is
-			int name_beg = pos;
-			//if current name is an absolute name, these are for saving the prefix as local name
-			int prefix_size = 0;
-			bool need_prefix = false;
-			int dot_mark = -1;
-			char* prefix_name;
-			
-			//count size of name (and maybe prefix name) to malloc correctly
-			while(1)
-			{
-				name_size++;
-				//if '.' is found then this name is an absolute name; set flag to save prefix
-				if(c[pos] == '.' && dot_mark == -1)
-				{	
-					prefix_size = name_size;
-					prefix_name = malloc(prefix_size);
-					need_prefix = true;
-					dot_mark = (pos + 1);		
-				}
-				if(c[pos] == '\0')
-				{
-					pos++;
-					break;
-				}
-				pos++;
-			}
+			end = memchr(c + pos, '\0', returned - pos);
 
-			char* new_name = malloc(name_size);
-			pos = name_beg;
-			
-			for(j = 0;; j++)
+			//a name cut off by the end of the file ends the file
+			if(end == NULL)
 			{
-				new_name[j] = c[pos];
-				//if prefix needs to be saved, this is where separate creation of local name happens alongside absolute name
-				if((pos + 1) <= dot_mark)
-				{
-					prefix_name[j] = c[pos];
-					//end of prefix has been reached, insert '\0' instead of '.' and finish prefix name
-					if((pos + 1) == dot_mark)
-					{
-						prefix_name[j] = '\0';
-						jrb_insert_str(all_names, prefix_name, new_jval_v(computer));
-						dll_append(computer->names, new_jval_s(prefix_name));
-					}
-				}
-				if(c[pos] == '\0')
-				{
-					pos++;	
-					break;
-				}
-				pos++;
+				cut = true;
+				break;
 			}
+			len = end - (c + pos);
 
-			jrb_insert_str(all_names, new_name, new_jval_v(computer));
-			dll_append(computer->names, new_jval_s(new_name));
+			hostdb_add_name(db, (char*) c + pos, len);
+			pos += len + 1;
 		}
 	}
-	
-	//begin user input
-	
-	char* input = malloc(100);
-	JRB find_node;
-	JRB found;
-	Dllist print;
-	
-	printf("Hosts all read in\n\n");
-	
-	//prompt continuously until EOF
-	while(1)
-	{	
-		printf("Enter host name: ");
-
-		if(scanf("%s", input) == EOF)
-			break;
-	
-		find_node = jrb_find_str(all_names, input);
 
-		//if name exists, print ip and all names
-		if(find_node != NULL)
-		{
-			jrb_traverse(found, all_names)
-			{
-				if(strcmp(input, found->key.s) == 0)
-				{
-					//print ip
-					for(i = 0; i < 4; i++)
-					{
-						printf("%d", ((Computer)(found->val.v))->ip[i]);
-						if(i < 3)
-							printf(".");
-					}
-					printf(": ");
-
-					//print names
-					dll_traverse(print, ((Computer)(found->val.v))->names)
-					{
-						printf("%s ", print->val.s);
-					}
-					printf("\n\n");
-				}
-			}
-		}
-		else
-			printf("no key %s\n\n", input);
-	}
-
-	//memory management
-	
-	JRB delete;
-	Dllist node;
-
-	//traverse entire tree
-	jrb_traverse(delete, all_names)
-	{
-		Computer comp = (Computer)(delete->val.v);
-		
-		//reduce num_names by one to mark as visited, when 0 all names have been visited and computer pointer can be entirely freed
-		comp->num_names--;
-		if(comp->num_names == 0)
-		{
-			//free names in dllist
-			dll_traverse(node, comp->names)
-			{
-				free(node->val.s);
-			}
-			free_dllist(comp->names);
-			//free member variables
-			free(comp->ip);
-			free(comp);
-		}
-	}
-	
-	jrb_free_tree(all_names);
-	
-	//free misc memory
+	//every name has been copied out, so the buffer can go now
 	free(c);
-	free(ip);
-	free(input);
+
+	//begin user input, then free the database
+	hostdb_query(db, batch);
+	free_hostdb(db);
 
 	return 0;
 }
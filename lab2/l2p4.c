@@ -0,0 +1,37 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab2: l2p4.c
+ * This program reads a file "converted" that represents a list of ip addresses and
+ * associated names and stores the data in a hash table (see hostdb.c). The user is then
+ * allowed to search through the database repeatedly, or with -b names are read from
+ * standard input without prompts. This version maps the file into memory with mmap, and
+ * the names in the database point into the mapping instead of being copied, so the file
+ * can be any size and loading it allocates nothing per name.
+ * 09/14/2020 */
+
+#include "hostdb.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+int main(int argc, char** argv)
+{
+	HostDB db = make_hostdb();
+
+	//-b answers names from standard input without prompting
+	bool batch = (argc > 1 && strcmp(argv[1], "-b") == 0);
+
+	if(!hostdb_map(db, "converted"))
+	{
+		perror("converted");
+		free_hostdb(db);
+		return 1;
+	}
+
+	//begin user input, then free the database and unmap the file
+	hostdb_query(db, batch);
+	free_hostdb(db);
+
+	return 0;
+}
@@ -0,0 +1,44 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab2: l2p5.c
+ * This program answers the same queries as l2p1 through l2p4 (names, addresses, prefixes
+ * and fuzzy names), but from the index "converted.idx" that l2idx builds from "converted"
+ * (see hostidx.c). The index is mapped into memory and used as it is, so nothing is read
+ * or built before the first query however big the database is. The user is allowed to
+ * search through the database repeatedly, or with -b names are read from standard input
+ * without prompts.
+ * 09/14/2020 */
+
+#include "hostidx.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+int main(int argc, char** argv)
+{
+	HostIdx idx;
+	struct stat convertedStat, idxStat;
+
+	//-b answers names from standard input without prompting
+	bool batch = (argc > 1 && strcmp(argv[1], "-b") == 0);
+
+	idx = hostidx_open("converted.idx");
+	if(idx == NULL)
+	{
+		perror("converted.idx");
+		fprintf(stderr, "run l2idx to build it from converted\n");
+		return 1;
+	}
+
+	//the index still answers, but from the old data
+	if(stat("converted", &convertedStat) == 0 && stat("converted.idx", &idxStat) == 0
+		&& convertedStat.st_mtime > idxStat.st_mtime)
+		fprintf(stderr, "converted.idx is older than converted, run l2idx to rebuild it\n");
+
+	hostidx_query(idx, batch);
+	hostidx_close(idx);
+
+	return 0;
+}
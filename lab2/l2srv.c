@@ -0,0 +1,302 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab2: l2srv.c
+ * This program loads a file "converted" that represents a list of ip addresses and
+ * associated names once and answers queries for it over a UNIX socket, "l2p.sock", so
+ * any number of l2client processes share one copy of the database.
+ * Another file can be given as the first argument, and another socket as the second.
+ * Each client gets its own thread. A client sends one name (or address, or CIDR block)
+ * per line and gets back what l2p4 -b would print for it, then a line with just ".".
+ * A database isn't changed once it is loaded, so the threads read it without locks.
+ * When "converted" changes (and then stays the same for a second), or on SIGHUP, a new
+ * database is loaded by another thread and swapped in. Every query takes a reference to
+ * the database that is current when it starts, so queries never wait for a reload, and
+ * an old database is freed when the last query using it finishes.
+ * 09/14/2020 */
+
+#include "hostdb.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+//one loaded database. refs counts the queries using it, plus one while it is the current one
+typedef struct Version
+{
+	HostDB db;
+	int refs;
+} *Version;
+
+//current only changes under the lock, and refs only changes under it
+static Version current;
+static pthread_mutex_t current_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Version load(char* input);
+static Version acquire();
+static void release(Version version);
+static bool same_file(struct stat* a, struct stat* b);
+static void* reload(void* arg);
+static void* serve(void* arg);
+
+int main(int argc, char** argv)
+{
+	char* input = (argc > 1) ? argv[1] : "converted";
+	char* path = (argc > 2) ? argv[2] : SOCKET_NAME;
+	struct sockaddr_un addr;
+	pthread_t thread;
+	sigset_t hangup;
+	int listener, probe, client;
+	int* arg;
+
+	if(argc > 3)
+	{
+		fprintf(stderr, "usage: l2srv [converted [socket]]\n");
+		return 1;
+	}
+	if(strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "%s: socket path is too long\n", path);
+		return 1;
+	}
+
+	current = load(input);
+	if(current == NULL)
+	{
+		perror(input);
+		return 1;
+	}
+
+	//SIGHUP is taken by the reload thread only, every thread made from here on has it blocked
+	sigemptyset(&hangup);
+	sigaddset(&hangup, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &hangup, NULL);
+	if(pthread_create(&thread, NULL, reload, input) != 0)
+	{
+		perror("pthread_create");
+		return 1;
+	}
+	pthread_detach(thread);
+
+	//a client that hangs up in the middle of an answer shouldn't kill the server
+	signal(SIGPIPE, SIG_IGN);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	//a socket left behind by a server that is gone is replaced, one a server still answers on isn't
+	probe = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(probe >= 0 && connect(probe, (struct sockaddr*) &addr, sizeof(addr)) == 0)
+	{
+		fprintf(stderr, "%s: another l2srv is already listening\n", path);
+		return 1;
+	}
+	if(probe >= 0)
+		close(probe);
+	unlink(path);
+
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listener < 0 || bind(listener, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(listener, SOMAXCONN) < 0)
+	{
+		perror(path);
+		return 1;
+	}
+
+	printf("l2srv: %d computers, listening on %s\n", current->db->num_computers, path);
+	fflush(stdout);
+
+	while(1)
+	{
+		client = accept(listener, NULL, NULL);
+		if(client < 0)
+		{
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			perror("accept");
+			break;
+		}
+
+		arg = malloc(sizeof(int));
+		*arg = client;
+		if(pthread_create(&thread, NULL, serve, arg) != 0)
+		{
+			close(client);
+			free(arg);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	close(listener);
+	unlink(path);
+
+	return 1;
+}
+
+/* reads a database and gets it ready to be shared: it is read instead of mapped, so rewriting the
+ * file can't pull pages out from under queries, and what queries by address and prefix use is
+ * sorted now, so the threads only ever read it. NULL if the file can't be read */
+static Version load(char* input)
+{
+	Version version;
+	HostDB db = make_hostdb();
+
+	if(!hostdb_read(db, input))
+	{
+		free_hostdb(db);
+		return NULL;
+	}
+	hostdb_prepare(db);
+
+	version = malloc(sizeof(struct Version));
+	version->db = db;
+	version->refs = 1;
+
+	return version;
+}
+
+//the current database, which stays loaded until it is released
+static Version acquire()
+{
+	Version version;
+
+	pthread_mutex_lock(&current_lock);
+	version = current;
+	version->refs++;
+	pthread_mutex_unlock(&current_lock);
+
+	return version;
+}
+
+//frees a database once nothing uses it and it isn't current anymore
+static void release(Version version)
+{
+	bool last;
+
+	pthread_mutex_lock(&current_lock);
+	last = (--version->refs == 0);
+	pthread_mutex_unlock(&current_lock);
+
+	if(last)
+	{
+		free_hostdb(version->db);
+		free(version);
+	}
+}
+
+static bool same_file(struct stat* a, struct stat* b)
+{
+	return a->st_ino == b->st_ino && a->st_size == b->st_size && a->st_mtim.tv_sec == b->st_mtim.tv_sec
+		&& a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+/* checks the file every second, and reloads it once it has changed and then held still for a
+ * second so a file that is still being written isn't read half done. SIGHUP reloads right away */
+static void* reload(void* arg)
+{
+	char* input = (char*) arg;
+	struct stat loaded, last, now;
+	struct timespec second = {1, 0};
+	sigset_t hangup;
+	Version version, old;
+	bool hup;
+
+	sigemptyset(&hangup);
+	sigaddset(&hangup, SIGHUP);
+	if(stat(input, &loaded) < 0)
+		memset(&loaded, 0, sizeof(loaded));
+	last = loaded;
+
+	while(1)
+	{
+		hup = (sigtimedwait(&hangup, NULL, &second) == SIGHUP);
+		if(stat(input, &now) < 0)
+		{
+			memset(&last, 0, sizeof(last));
+			continue;
+		}
+		if(!hup && (same_file(&now, &loaded) || !same_file(&now, &last)))
+		{
+			last = now;
+			continue;
+		}
+		last = now;
+
+		//queries keep using the old database until the new one is ready
+		//a file that can't be read isn't tried again until it changes again
+		version = load(input);
+		loaded = now;
+		if(version == NULL)
+		{
+			perror(input);
+			continue;
+		}
+
+		pthread_mutex_lock(&current_lock);
+		old = current;
+		current = version;
+		pthread_mutex_unlock(&current_lock);
+		release(old);
+
+		printf("l2srv: reloaded %s, %d computers\n", input, version->db->num_computers);
+		fflush(stdout);
+	}
+
+	return NULL;
+}
+
+//answers one client until it hangs up
+static void* serve(void* arg)
+{
+	int fd = *(int*) arg;
+	FILE* in;
+	FILE* out;
+	Version version;
+	char* line = NULL;
+	size_t size = 0;
+	ssize_t len;
+
+	free(arg);
+	in = fdopen(fd, "r");
+	out = fdopen(dup(fd), "w");
+	if(in == NULL || out == NULL)
+	{
+		if(in != NULL)
+			fclose(in);
+		else
+			close(fd);
+		return NULL;
+	}
+
+	while((len = getline(&line, &size, in)) >= 0)
+	{
+		//one query per line, cut off at MAX_INPUT like scanf() cuts it off in the other programs
+		if(len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if(len > MAX_INPUT)
+			line[MAX_INPUT] = '\0';
+
+		//the answer is all in out's buffer before the database is let go
+		version = acquire();
+		hostdb_answer(out, version->db, line);
+		release(version);
+
+		fputs(END_OF_ANSWER, out);
+		if(fflush(out) == EOF)
+			break;
+	}
+
+	free(line);
+	fclose(in);
+	fclose(out);
+
+	return NULL;
+}
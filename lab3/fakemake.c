@@ -1,51 +1,159 @@
 /* Author: Zachery Creech
  * COSC360 Fall 2020
  * Lab3: fakemake.c
- * This program uses stat(2v) and system(3) to automate compiling of a single executable. It
+ * This program uses stat(2v) and posix_spawn(3) to automate compiling of executables. It
  * reads compilation instructions (names of .c and .h files, flags, and libraries) from
  * description-file specified by argv[1]. First it stores the instructions, then it checks
- * all files using stat() to determine what needs to be recompiled based on the algorithm 
- * given in the lab write-up for Lab3. It builds relevant command strings and calls system() on 
- * them to execute compilation using gcc in the terminal. The program will exit upon encountering
- * an error and will output the relevant error message to stderr.
+ * all files using stat() to determine what needs to be recompiled based on the algorithm
+ * given in the lab write-up for Lab3. It builds an argument vector for each command and runs
+ * gcc (or ar) directly with posix_spawnp(), without going through a shell. The program will exit
+ * upon encountering an error and will output the relevant error message to stderr.
+ * With -j N, up to N commands run at once, and finished commands are collected with waitpid().
+ * After the first failed command no new ones are started. With --dry-run the commands that would
+ * run are printed (as shell command lines) but nothing is run.
+ * A description-file can describe several targets. Each E line starts an executable and each
+ * A line starts a static library (built with ar). C, H, F and L lines before the first E or A
+ * line are shared by every target, later ones belong to the target above them, so a file with a
+ * single E line means the same thing as before wherever the E line is. A library target named on
+ * an L line is built before anything that links with it. All of this becomes one dependency graph
+ * of objects, libraries and executables: a .c file listed by several targets is compiled once
+ * (with the flags and headers of the first target that lists it), and a node is started as soon
+ * as everything it depends on is finished.
+ * Every compile also writes a gcc depfile (-MMD -MF file.d) listing the headers that .c file
+ * really includes. When a depfile exists, only those headers decide whether the object is out of
+ * date, so touching one header only recompiles the files that include it. Objects without a
+ * depfile fall back to comparing against every H file of the target.
+ * With --cache dir (or FAKEMAKE_CACHE set in the environment), objects are kept in a build cache
+ * keyed by the contents of their source and headers and the exact command (see fmcache.c). A
+ * stale object found in the cache is copied into place instead of compiled, so a clean checkout
+ * or a rebuild after touching files costs a copy per object rather than a compile.
+ * The state of the last build is kept in .fakemake.state (see fmstate.c): the content hash of every
+ * source and header, and for every object the headers it included and a signature of the command
+ * and input contents it was built from. An object with a record is only rebuilt when that
+ * signature changes, so touching a file without changing it rebuilds nothing, and headers come
+ * from the record instead of the depfile. Files are stat()ed in one parallel pass up front and
+ * only read again when their mtime or size changed.
+ * With --trace file.json, the start and end of every command are written as a Chrome trace, and
+ * the build time, critical path and slowest compiles are printed at the end (see fmtrace.c).
+ * With --watch, fakemake stays running after the build with the graph in memory, watches its
+ * sources, headers and the description-file with inotify (see fmwatch.c) and, whenever some
+ * change, stat()s just those files and rebuilds whatever is stale. The objects and targets it
+ * writes (or a failed link deletes) aren't watched, so its own commands never wake it up, and a
+ * failed command doesn't end watch mode but waits for an input to change. A changed
+ * description-file starts fakemake over with the same arguments.
  * 09/26/2020 */
 
 #include "jval.h"
 #include "fields.h"
 #include "dllist.h"
+#include "jrb.h"
+#include "fakemake.h"
+#include "fmcache.h"
+#include "fmstate.h"
+#include "fmtrace.h"
+#include "fmwatch.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <errno.h>
 
-typedef struct Fakemake
-{
-	char* name;
-	Dllist sources;
-	Dllist headers;
-	Dllist flags;
-	Dllist libraries;
-	Dllist objects;
-} *Fakemake;
+extern char** environ;
 
 char* c_to_o(char* source);
-char* compile(Fakemake fakemake, Dllist traverse, char type);
-char* c_compile(Fakemake fakemake, Dllist source);
-char* e_compile(Fakemake fakemake, Dllist next_string);
-char* add_string(char* s1, char* s2);
+char* c_to_d(char* source);
+bool headers_newer(Node node, long object_time);
+bool node_signature(Node node, Dllist headers, char* hex);
+void record_outputs(Dllist order);
+Command c_compile(Fakemake fakemake, Node node);
+Command e_compile(Fakemake fakemake);
+Command a_compile(Fakemake fakemake);
+Command new_command();
+void add_arg(Command command, char* arg);
+void add_args(Command command, Dllist args);
+void finish_command(Command command);
+void free_command(Command command);
+Fakemake new_fakemake(char* name, char type, Fakemake common);
+void copy_strings(Dllist from, Dllist to);
 void free_memory(IS is, Fakemake fakemake);
+Node add_node(JRB nodes, Dllist order, char* name, char type, Fakemake target);
+void add_dependency(Node node, Node dependency);
+bool check_files(Dllist targets);
+bool is_stale(Node node, Dllist targets);
+Command node_command(Node node);
+bool build(Dllist order, Dllist targets, int* commands_run);
+bool run_build(Dllist order, Dllist targets, char* trace, int* commands_run);
+void reset_graph(Dllist order);
+void watch_graph(Dllist order, char* fakefile);
+void finish_node(Node node, Dllist ready);
+pid_t start_job(Command command);
+pid_t wait_job(bool* ok);
+
+//most commands allowed to run at once (-j), and how many are running now
+int max_jobs = 1;
+int running_jobs = 0;
+
+//--dry-run, print commands without running them
+bool dry_run = false;
+
+//--watch, keep rebuilding as files change
+bool watch = false;
+
+#define STATE_FILE ".fakemake.state"
 
 int main(int argc, char** argv)
 {
 	char* fakefile;
-	
+	char* cache;
+	char* trace = NULL;
+	int arg = 1;
+
+	/* -j N or -jN sets how many commands can run at once, --cache dir turns on the build cache,
+	 * --dry-run only prints commands, --trace writes a trace of the build and prints a summary and
+	 * --watch rebuilds whenever a file changes */
+	cache = getenv("FAKEMAKE_CACHE");
+	while(arg < argc && argv[arg][0] == '-')
+	{
+		if(strncmp(argv[arg], "-j", 2) == 0)
+		{
+			if(argv[arg][2] != '\0')
+				max_jobs = atoi(argv[arg] + 2);
+			else if(arg + 1 < argc)
+				max_jobs = atoi(argv[++arg]);
+			else
+				max_jobs = 0;
+		}
+		else if(strcmp(argv[arg], "--cache") == 0 && arg + 1 < argc)
+			cache = argv[++arg];
+		else if(strcmp(argv[arg], "--dry-run") == 0)
+			dry_run = true;
+		else if(strcmp(argv[arg], "--trace") == 0 && arg + 1 < argc)
+			trace = argv[++arg];
+		else if(strcmp(argv[arg], "--watch") == 0)
+			watch = true;
+		else
+			max_jobs = 0;
+		arg++;
+
+		if(max_jobs < 1)
+		{
+			fprintf(stderr, "usage: %s [-j jobs] [--cache dir] [--dry-run] [--trace file.json] [--watch] [description-file]\n", argv[0]);
+			return -1;
+		}
+	}
+	if(cache != NULL && cache[0] != '\0')
+		cache_init(cache);
+
 	//if no file is specified in command arguments, assume file is called "fmakefile"
-	if(argc < 2)
-		fakefile = "fmakefile";	
+	if(argc <= arg)
+		fakefile = "fmakefile";
 	else
-		fakefile = argv[1];
+		fakefile = argv[arg];
 
 	//for cleaning directory as shown in the writeup, but does not do anything for gradescripts
 	if(strcmp(fakefile, "clean") == 0)
@@ -54,30 +162,25 @@ int main(int argc, char** argv)
 		system("rm -f core *.o f mysort");
 		return 0;
 	}
-	
+
 	//opening input file and error checking
 	IS is = new_inputstruct(fakefile);
-	
+
 	if(is == NULL)
 	{
 		fprintf(stderr, "fmakefile cannot open %s: No such file or directory\n", fakefile);
 		return -1;
 	}
-	
-	//create and allocate memory for new Fakemake object that stores strings for compiling new executable
-	//program could be changed to create multiple executables at once by instantiating many Fakemake objects
-	Fakemake fakemake = malloc(sizeof(struct Fakemake));
-	
-	//initialize all members of Fakemake object
-	fakemake->name = NULL;
-	fakemake->sources = new_dllist();
-	fakemake->headers = new_dllist();
-	fakemake->flags = new_dllist();
-	fakemake->libraries = new_dllist();
-	fakemake->objects = new_dllist();
+
+	/* lines before the first E or A line go into common, which every target starts out with.
+	 * After that, lines go into the most recent target */
+	Fakemake common = new_fakemake(NULL, 0, NULL);
+	Fakemake fakemake = common;
+	Dllist targets = new_dllist();
+	Dllist tmp;
 
 	int i;
-	
+
 	//go through entire fmakefile and extract all instructions for compiling
 	while(get_line(is) >= 0)
 	{
@@ -97,19 +200,24 @@ int main(int argc, char** argv)
 			for(i = 1; i < is->NF; i++)
 				dll_append(fakemake->headers, new_jval_s(strdup(is->fields[i])));
 		}
-		//add executable name. Every fmakefile must contain exactly ONE E line
-		else if(strcmp(is->fields[0], "E") == 0)
+		//start a new executable or library. Each E or A line names exactly one target
+		else if(strcmp(is->fields[0], "E") == 0 || strcmp(is->fields[0], "A") == 0)
 		{
-			for(i = 1; i < is->NF; i++)
+			if(is->NF != 2)
 			{
-				if(fakemake->name != NULL)
+				fprintf(stderr, "fmakefile (%d) %s line must name exactly one target\n", is->line, is->fields[0]);
+				return -1;
+			}
+			dll_traverse(tmp, targets)
+			{
+				if(strcmp(((Fakemake) tmp->val.v)->name, is->fields[1]) == 0)
 				{
-					fprintf(stderr, "fmakefile (%d) cannot have more than one E line\n", is->line);
+					fprintf(stderr, "fmakefile (%d) %s is already a target\n", is->line, is->fields[1]);
 					return -1;
 				}
-				else
-					fakemake->name = strdup(is->fields[i]);
 			}
+			fakemake = new_fakemake(is->fields[1], is->fields[0][0] == 'E' ? 'e' : 'a', common);
+			dll_append(targets, new_jval_v(fakemake));
 		}
 		//add all flags
 		else if(strcmp(is->fields[0], "F") == 0)
@@ -121,127 +229,682 @@ int main(int argc, char** argv)
 		else if(strcmp(is->fields[0], "L") == 0)
 		{
 			for(i = 1; i < is->NF; i++)
-				dll_append(fakemake->libraries, new_jval_v(strdup(is->fields[i])));
+				dll_append(fakemake->libraries, new_jval_s(strdup(is->fields[i])));
 		}
 	}
-	
+
 	//needs an executable name
-	if(fakemake->name == NULL)
+	if(dll_empty(targets))
 	{
 		fprintf(stderr, "No executable specified\n");
 		return -1;
 	}
-	
+
 	//finished reading in all instructions
-	
-	//check all .h files to find the most recent one, error checking
-	Dllist file;
-	struct stat fileStat;
 
-	long newest_header = -1;
+	/* build the dependency graph. Objects are shared between targets by name, and a target
+	 * depends on its objects and on any library target it links with */
+	JRB nodes = make_jrb();
+	JRB found;
+	Dllist order = new_dllist();
+	Dllist source, library, header;
+	Node node, object;
+	char* object_name;
+	Output output;
+
+	state_load(STATE_FILE);
 
-	dll_traverse(file, fakemake->headers)
+	dll_traverse(tmp, targets)
 	{
-		//if stat() returns < 0, file does not exist in current directory
-		if(stat(file->val.s, &fileStat) < 0)
+		fakemake = (Fakemake) tmp->val.v;
+		dll_traverse(source, fakemake->sources)
 		{
-			fprintf(stderr, "fmakefile: %s: No such file or directory\n");
-			return -1;
+			object_name = c_to_o(source->val.s);
+			dll_append(fakemake->objects, new_jval_s(object_name));
+			found = jrb_find_str(nodes, object_name);
+			if(found == NULL)
+			{
+				object = add_node(nodes, order, object_name, 'c', fakemake);
+				object->source = source->val.s;
+				object->depfile = c_to_d(source->val.s);
+
+				//everything is stat()ed at once below, including headers from the last build
+				stat_add(object->name);
+				stat_add(object->source);
+				output = find_output(object->name);
+				if(output != NULL)
+				{
+					dll_traverse(header, output->headers)
+						stat_add(header->val.s);
+				}
+			}
 		}
-		else
+	}
+
+	dll_traverse(tmp, targets)
+	{
+		fakemake = (Fakemake) tmp->val.v;
+		node = add_node(nodes, order, fakemake->name, fakemake->type, fakemake);
+		stat_add(node->name);
+		dll_traverse(source, fakemake->headers)
+			stat_add(source->val.s);
+		dll_traverse(source, fakemake->objects)
+			add_dependency(node, jrb_find_str(nodes, source->val.s)->val.v);
+	}
+
+	//libraries can only be matched up once every target has a node
+	dll_traverse(tmp, targets)
+	{
+		fakemake = (Fakemake) tmp->val.v;
+		node = jrb_find_str(nodes, fakemake->name)->val.v;
+		dll_traverse(library, fakemake->libraries)
 		{
-			if(fileStat.st_mtime > newest_header)
-				newest_header = fileStat.st_mtime;
+			found = jrb_find_str(nodes, library->val.s);
+			if(found != NULL && ((Node) found->val.v)->type == 'a')
+				add_dependency(node, found->val.v);
 		}
 	}
 
-	//check all .c files and corresponding .o files according to algorithm in lab write-up
-	Dllist source;
-	int c_time = -1, e_time = -1;
-	char* object;
-	bool need_e = false, need_c = false;
-
-	char* c_command = NULL;
-	
-	dll_traverse(source, fakemake->sources)
-	{
-		//create all object strings for comparison stat() to executable and possible compilation of executable later
-		object = c_to_o(source->val.s);
-		dll_append(fakemake->objects, new_jval_s(object));
-		
-		//error checking
-		if(stat(source->val.s, &fileStat) < 0)
+	stat_all();
+
+	//every .h and .c file has to exist before anything is built
+	if(!check_files(targets))
+		return -1;
+
+	//run every stale node in dependency order
+	int commands_run = 0;
+	bool built;
+	Dllist changed;
+
+	built = run_build(order, targets, trace, &commands_run);
+
+	/* in watch mode the graph stays as it is, and after each round of changes only the files that
+	 * changed are stat()ed again before every node is checked again */
+	if(watch)
+	{
+		if(built && commands_run == 0)
 		{
-			fprintf(stderr, "fmakefile: %s: No such file or directory\n", source->val.s);
-			return -1;
+			dll_traverse(tmp, targets)
+			{
+				printf("%s up to date\n", ((Fakemake) tmp->val.v)->name);
+			}
+			printf("fakemake: watching for changes\n");
 		}
-		else
+		if(!watch_init())
+			return -1;
+		while(1)
 		{
-			//compare .o file to corresponding .c file and most recent header to decide if .c file needs to be recompiled
-			c_time = fileStat.st_mtime;
-			if(stat(object, &fileStat) < 0 || fileStat.st_mtime < c_time || fileStat.st_mtime < newest_header)
+			if(commands_run > 0 || !built)
+				printf("fakemake: watching for changes\n");
+			fflush(stdout);
+			watch_graph(order, fakefile);
+
+			changed = watch_wait();
+			dll_traverse(tmp, changed)
 			{
-				//set flags for relevant output and errors
-				need_c = true;
-				need_e = true;
-				
-				//get command to compile .c file, print it and execute command with system()
-				c_command = compile(fakemake, source, 'c');
-				printf("%s\n", c_command);
-				if(system(c_command) != 0)
-				{	
-					fprintf(stderr, "Command failed.  Exiting\n");
+				//a new description-file can mean a new graph, so start over and read it again
+				if(strcmp(tmp->val.s, fakefile) == 0)
+				{
+					printf("fakemake: %s changed, starting over\n", fakefile);
+					fflush(stdout);
+					execvp(argv[0], argv);
+					perror(argv[0]);
 					return -1;
 				}
-				free(c_command);
+				file_refresh(tmp->val.s);
 			}
+			free_dllist(changed);
 
+			reset_graph(order);
+			commands_run = 0;
+			built = run_build(order, targets, trace, &commands_run);
 		}
 	}
-	
-	//check if executable already exists to set relevant flags
-	if(stat(fakemake->name, &fileStat) < 0)
-		need_e = true;
+
+	if(!built)
+		return -1;
+
+	//no compilation needed
+	if(commands_run == 0)
+	{
+		dll_traverse(tmp, targets)
+		{
+			printf("%s up to date\n", ((Fakemake) tmp->val.v)->name);
+		}
+		return -1;
+	}
+
+	dll_traverse(tmp, order)
+	{
+		node = (Node) tmp->val.v;
+		free_dllist(node->dependents);
+		free(node->depfile);
+		if(node->command != NULL)
+			free_command(node->command);
+		free(node);
+	}
+	free_dllist(order);
+	jrb_free_tree(nodes);
+	state_free();
+
+	dll_traverse(tmp, targets)
+	{
+		free_memory(NULL, tmp->val.v);
+	}
+	free_dllist(targets);
+	free_memory(is, common);
+
+	return 0;
+}
+
+//creates a target, starting out with strings from the common lines at the top of the fmakefile
+Fakemake new_fakemake(char* name, char type, Fakemake common)
+{
+	Fakemake fakemake = malloc(sizeof(struct Fakemake));
+
+	//initialize all members of Fakemake object
+	fakemake->name = (name == NULL) ? NULL : strdup(name);
+	fakemake->type = type;
+	fakemake->sources = new_dllist();
+	fakemake->headers = new_dllist();
+	fakemake->flags = new_dllist();
+	fakemake->libraries = new_dllist();
+	fakemake->objects = new_dllist();
+
+	if(common != NULL)
+	{
+		copy_strings(common->sources, fakemake->sources);
+		copy_strings(common->headers, fakemake->headers);
+		copy_strings(common->flags, fakemake->flags);
+		copy_strings(common->libraries, fakemake->libraries);
+	}
+
+	return fakemake;
+}
+
+//adds copies of the strings in from to the end of to, in order
+void copy_strings(Dllist from, Dllist to)
+{
+	Dllist tmp;
+
+	dll_traverse(tmp, from)
+	{
+		dll_append(to, new_jval_s(strdup(tmp->val.s)));
+	}
+}
+
+//check all .h and .c files of every target, error checking
+bool check_files(Dllist targets)
+{
+	Dllist tmp, file;
+	Fakemake fakemake;
+
+	dll_traverse(tmp, targets)
+	{
+		fakemake = (Fakemake) tmp->val.v;
+		dll_traverse(file, fakemake->headers)
+		{
+			//if stat() failed, file does not exist in current directory
+			if(!file_info(file->val.s)->exists)
+			{
+				fprintf(stderr, "fmakefile: %s: No such file or directory\n", file->val.s);
+				return false;
+			}
+		}
+		dll_traverse(file, fakemake->sources)
+		{
+			if(!file_info(file->val.s)->exists)
+			{
+				fprintf(stderr, "fmakefile: %s: No such file or directory\n", file->val.s);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//creates a graph node for a file and remembers it both by name and in creation order
+Node add_node(JRB nodes, Dllist order, char* name, char type, Fakemake target)
+{
+	Node node = malloc(sizeof(struct Node));
+
+	node->name = name;
+	node->type = type;
+	node->source = NULL;
+	node->depfile = NULL;
+	node->command = NULL;
+	node->target = target;
+	node->dependents = new_dllist();
+	node->waiting = 0;
+	node->rebuilt = false;
+	node->dependency_rebuilt = false;
+	node->done = false;
+	node->lane = 0;
+	node->start = -1;
+	node->end = -1;
+	node->cached = false;
+	node->path_time = -1;
+	node->path_next = NULL;
+
+	jrb_insert_str(nodes, name, new_jval_v(node));
+	dll_append(order, new_jval_v(node));
+
+	return node;
+}
+
+void add_dependency(Node node, Node dependency)
+{
+	dll_append(dependency->dependents, new_jval_v(node));
+	node->waiting++;
+}
+
+/* decides whether a node has to be rebuilt, according to algorithm in lab write-up. It is only
+ * called once everything the node depends on is finished, so their times are final. An object
+ * with a record from the last build is compared by contents instead */
+bool is_stale(Node node, Dllist targets)
+{
+	FileInfo info;
+	Dllist tmp, file;
+	Fakemake fakemake = node->target;
+	Output output;
+	char signature[HASH_HEX];
+	long own_time;
+
+	if(node->type == 'c')
+	{
+		//an object that is still exactly what was last built only depends on its inputs' contents
+		info = file_info(node->name);
+		output = find_output(node->name);
+		if(info->exists && output != NULL && output->mtime_ns == info->mtime_ns && output->size == info->size)
+			return !node_signature(node, output->headers, signature) || strcmp(signature, output->signature) != 0;
+
+		//compare .o file to corresponding .c file and its headers to decide if .c file needs to be recompiled
+		own_time = file_info(node->source)->mtime;
+		if(!info->exists || info->mtime < own_time)
+			return true;
+		return headers_newer(node, info->mtime);
+	}
+
+	//check if executable or library already exists, anything it's made from being rebuilt also makes it stale
+	info = file_info(node->name);
+	if(node->dependency_rebuilt || !info->exists)
+		return true;
+	own_time = info->mtime;
+
+	//compare executable time to object files, if any object is more recent (or was just rebuilt) then relink
+	dll_traverse(file, fakemake->objects)
+	{
+		info = file_info(file->val.s);
+		if(!info->exists || own_time < info->mtime)
+			return true;
+	}
+
+	//same for libraries that are targets of this fmakefile
+	dll_traverse(file, fakemake->libraries)
+	{
+		dll_traverse(tmp, targets)
+		{
+			if(strcmp(((Fakemake) tmp->val.v)->name, file->val.s) == 0)
+			{
+				info = file_info(file->val.s);
+				if(info->exists && own_time < info->mtime)
+					return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/* true if a header of the node's source changed after the object was made. The headers are the
+ * ones in the depfile from the last compile, or every H file of the target if there isn't one */
+bool headers_newer(Node node, long object_time)
+{
+	FileInfo info;
+	Dllist headers, file;
+	bool newer = false;
+
+	headers = read_depfile(node->depfile);
+	if(headers == NULL)
+	{
+		dll_traverse(file, node->target->headers)
+		{
+			info = file_info(file->val.s);
+			if(info->exists && info->mtime > object_time)
+				return true;
+		}
+		return false;
+	}
+
+	//a header that has disappeared was renamed or removed, so the source has to be compiled again to find out
+	dll_traverse(file, headers)
+	{
+		if(!newer)
+		{
+			info = file_info(file->val.s);
+			if(!info->exists || info->mtime > object_time)
+				newer = true;
+		}
+		free(file->val.s);
+	}
+	free_dllist(headers);
+
+	return newer;
+}
+
+/* hash of everything an object is built from: its command line and the contents of its source and
+ * headers. false if one of them can't be read, which always means the object has to be rebuilt */
+bool node_signature(Node node, Dllist headers, char* hex)
+{
+	Command command;
+	Dllist file;
+	char* hash;
+	char* text;
+	int size;
+	bool ok = true;
+
+	command = node_command(node);
+	size = strlen(command->line) + strlen(node->source) + HASH_HEX + 3;
+	dll_traverse(file, headers)
+	{
+		size += strlen(file->val.s) + HASH_HEX + 1;
+	}
+
+	text = malloc(size);
+	sprintf(text, "%s\n", command->line);
+	free_command(command);
+
+	hash = file_hash(node->source);
+	if(hash == NULL)
+		ok = false;
 	else
-		e_time = fileStat.st_mtime;
-	
-	Dllist cur_object;
+		sprintf(text + strlen(text), "%s %s\n", hash, node->source);
+
+	dll_traverse(file, headers)
+	{
+		if(!ok)
+			break;
+		hash = file_hash(file->val.s);
+		if(hash == NULL)
+			ok = false;
+		else
+			sprintf(text + strlen(text), "%s %s\n", hash, file->val.s);
+	}
+
+	if(ok)
+		hash_string(text, hex);
+	free(text);
+
+	return ok;
+}
+
+/* records every object that was just built, or that was up to date but has no record yet, along
+ * with the headers from its depfile. Objects that failed or never started keep their old record */
+void record_outputs(Dllist order)
+{
+	Dllist tmp, headers, file;
+	Node node;
+	char signature[HASH_HEX];
+
+	dll_traverse(tmp, order)
+	{
+		node = (Node) tmp->val.v;
+		if(node->type != 'c' || !node->done || (!node->rebuilt && find_output(node->name) != NULL))
+			continue;
+
+		headers = read_depfile(node->depfile);
+		if(headers == NULL)
+			continue;
+		if(node_signature(node, headers, signature))
+		{
+			set_output(node->name, signature, headers);
+			continue;
+		}
+
+		dll_traverse(file, headers)
+		{
+			free(file->val.s);
+		}
+		free_dllist(headers);
+	}
+}
+
+//command that builds a node: the argv spawned directly with posix_spawnp() and the line printed for it
+Command node_command(Node node)
+{
+	if(node->type == 'c')
+		return c_compile(node->target, node);
+	else if(node->type == 'e')
+		return e_compile(node->target);
+
+	return a_compile(node->target);
+}
+
+/* builds the graph, then remembers what was built even if something failed and writes the trace.
+ * Returns whatever build() did */
+bool run_build(Dllist order, Dllist targets, char* trace, int* commands_run)
+{
+	bool built;
+
+	built = build(order, targets, commands_run);
+	if(!dry_run)
+	{
+		record_outputs(order);
+		if(!state_save(STATE_FILE))
+			perror(STATE_FILE);
+	}
+	if(trace != NULL && !dry_run && *commands_run > 0)
+	{
+		if(!trace_write(trace, order))
+			perror(trace);
+		trace_report(order, stdout);
+	}
+
+	return built;
+}
+
+//puts every node back the way it was before build(), so the graph can be built again
+void reset_graph(Dllist order)
+{
+	Dllist tmp, dependent;
+	Node node;
+
+	dll_traverse(tmp, order)
+	{
+		node = (Node) tmp->val.v;
+		node->waiting = 0;
+		node->rebuilt = false;
+		node->dependency_rebuilt = false;
+		node->done = false;
+		node->start = -1;
+		node->end = -1;
+		node->cached = false;
+		if(node->command != NULL)
+			free_command(node->command);
+		node->command = NULL;
+	}
+	dll_traverse(tmp, order)
+	{
+		dll_traverse(dependent, ((Node) tmp->val.v)->dependents)
+		{
+			((Node) dependent->val.v)->waiting++;
+		}
+	}
+}
+
+/* watches the inputs of the graph: the description-file, sources and headers, where the headers of
+ * an object are the ones from its last build if fakemake knows them and the H files otherwise.
+ * Objects and targets aren't watched, since the commands that write them would wake fakemake up.
+ * It is called after every build because a rebuilt object can include new headers */
+void watch_graph(Dllist order, char* fakefile)
+{
+	Dllist tmp, file, headers;
+	Node node;
+	Output output;
 
-	//compare executable time to object files, if any object is more recent then recompile executable
-	dll_traverse(cur_object, fakemake->objects)
+	watch_file(fakefile);
+	dll_traverse(tmp, order)
 	{
-		stat(cur_object->val.s, &fileStat);
-		if(e_time < fileStat.st_mtime)
+		node = (Node) tmp->val.v;
+		if(node->type != 'c')
+			continue;
+
+		watch_file(node->source);
+		output = find_output(node->name);
+		headers = (output != NULL) ? output->headers : node->target->headers;
+		dll_traverse(file, headers)
 		{
-			need_e = true;
+			watch_file(file->val.s);
+		}
+	}
+}
+
+/* runs the graph: nodes whose dependencies are all finished are ready, and ready nodes are started
+ * (up to max_jobs at a time) in the order they became ready. A node that isn't stale finishes
+ * right away. After a failed command nothing new starts, the running commands are waited for,
+ * and false is returned */
+bool build(Dllist order, Dllist targets, int* commands_run)
+{
+	Dllist ready = new_dllist();
+	Dllist tmp;
+	JRB jobs = make_jrb();
+	JRB job;
+	Node node;
+	Command command;
+	pid_t pid;
+	bool ok, failed = false;
+	bool* busy = calloc(max_jobs, sizeof(bool));
+
+	dll_traverse(tmp, order)
+	{
+		if(((Node) tmp->val.v)->waiting == 0)
+			dll_append(ready, tmp->val);
+	}
+
+	trace_init();
+
+	while(1)
+	{
+		while(!failed && running_jobs < max_jobs && !dll_empty(ready))
+		{
+			node = (Node) dll_first(ready)->val.v;
+			dll_delete_node(dll_first(ready));
+
+			if(!is_stale(node, targets))
+			{
+				finish_node(node, ready);
+				continue;
+			}
+
+			//get command to build the node, print it and start it. The node keeps it for the trace
+			command = node_command(node);
+			node->command = command;
+			node->rebuilt = true;
+			(*commands_run)++;
+
+			//with --dry-run the command is only printed
+			if(dry_run)
+			{
+				printf("%s\n", command->line);
+				finish_node(node, ready);
+				continue;
+			}
+
+			//the first free -j slot runs it
+			for(node->lane = 0; busy[node->lane]; node->lane++);
+			node->start = trace_now();
+
+			//an object already in the cache is copied into place and finishes right away
+			if(node->type == 'c' && cache_restore(node->source, command->line, node->name, node->depfile))
+			{
+				node->end = trace_now();
+				node->cached = true;
+				printf("%s (cached)\n", command->line);
+				file_refresh(node->name);
+				finish_node(node, ready);
+				continue;
+			}
+
+			printf("%s\n", command->line);
+			fflush(stdout);
+			pid = start_job(command);
+			if(pid < 0)
+			{
+				node->start = -1;
+				failed = true;
+				break;
+			}
+			jrb_insert_int(jobs, pid, new_jval_v(node));
+			busy[node->lane] = true;
+		}
+
+		if(running_jobs == 0)
 			break;
+
+		pid = wait_job(&ok);
+		job = jrb_find_int(jobs, pid);
+		if(job == NULL)
+			continue;
+		node = (Node) job->val.v;
+		jrb_delete_node(job);
+		node->end = trace_now();
+		busy[node->lane] = false;
+
+		if(ok && node->type == 'c')
+			cache_store(node->source, node->command->line, node->name, node->depfile);
+
+		if(!ok)
+		{
+			if(!failed)
+				fprintf(stderr, watch ? "Command failed.  Waiting for changes\n" : "Command failed.  Exiting\n");
+			failed = true;
+
+			//the command may have deleted or half written its output
+			file_refresh(node->name);
+			continue;
 		}
-	} 
+		file_refresh(node->name);
+		finish_node(node, ready);
+	}
+
+	free_dllist(ready);
+	jrb_free_tree(jobs);
+	free(busy);
+
+	if(failed)
+		return false;
 
-	//get command to compile executable, print it and execute command with system()
-	if(need_e)
+	//anything left over depends on itself through libraries
+	dll_traverse(tmp, order)
 	{
-		Dllist next_string;
-		char* e_command = compile(fakemake, next_string, 'e');
-		printf("%s\n", e_command);
-		if(system(e_command) != 0)
+		node = (Node) tmp->val.v;
+		if(!node->done)
 		{
-			fprintf(stderr, "Command failed.  Fakemake exiting\n");
-			return -1;
+			fprintf(stderr, "fmakefile: %s: circular dependency\n", node->name);
+			return false;
 		}
-		free(e_command);
 	}
-	
-	//no compilation needed
-	if(!need_c && !need_e)
+
+	return true;
+}
+
+//marks a node as finished and makes dependents that were only waiting on it ready
+void finish_node(Node node, Dllist ready)
+{
+	Dllist tmp;
+	Node dependent;
+
+	node->done = true;
+	dll_traverse(tmp, node->dependents)
 	{
-		printf("%s up to date\n", fakemake->name);
-		return -1;
+		dependent = (Node) tmp->val.v;
+		if(node->rebuilt)
+			dependent->dependency_rebuilt = true;
+		dependent->waiting--;
+		if(dependent->waiting == 0)
+			dll_append(ready, new_jval_v(dependent));
 	}
-	
-	free_memory(is, fakemake);
-	
-	return 0;
 }
 
 //creates string corresponding to .c file that ends in .o for string comparisons while checking with stat() and for executable compilation
@@ -258,105 +921,208 @@ char* c_to_o(char* source)
 	return object;
 }
 
-//calls either c_compile or e_compile for .c file compilation or executable compilation respectively, specified by 'c' or 'e'
-//after command is generated from all necessary strings, remove the whitespace left from calling add_string()
-char* compile(Fakemake fakemake, Dllist traverse, char type)
+//name of the depfile gcc writes when compiling source, the object's name ending in .d
+char* c_to_d(char* source)
 {
-	char* raw_command;
+	char* depfile = c_to_o(source);
 
-	if(type == 'c')
-		raw_command = c_compile(fakemake, traverse);
-	else if(type == 'e')
-		raw_command = e_compile(fakemake, traverse);
+	depfile[strlen(depfile) - 1] = 'd';
 
-	//remove trailing space left behind from add_string(), final version of string stored in fin_command
-	char* fin_command = calloc(strlen(raw_command), sizeof(char));
-	//copy everything over except \0, then replace the last char (which is whitespace ' ') with \0
-	memcpy(fin_command, raw_command, strlen(raw_command) - 1);
-	fin_command[strlen(fin_command)] = '\0';
-	free(raw_command);
+	return depfile;
+}
 
-	return fin_command;
+//constructs command to compile a .c file: gcc -c, the flags, a depfile option, then the .c file
+Command c_compile(Fakemake fakemake, Node node)
+{
+	Command command = new_command();
+
+	add_arg(command, "gcc");
+	add_arg(command, "-c");
+	add_args(command, fakemake->flags);
+
+	//have gcc list the headers the file includes
+	add_arg(command, "-MMD");
+	add_arg(command, "-MF");
+	add_arg(command, node->depfile);
+
+	add_arg(command, node->source);
+	finish_command(command);
+
+	return command;
+}
+
+//constructs command to link an executable: gcc -o name, the flags, all .o files, then the libraries
+Command e_compile(Fakemake fakemake)
+{
+	Command command = new_command();
+
+	add_arg(command, "gcc");
+	add_arg(command, "-o");
+	add_arg(command, fakemake->name);
+	add_args(command, fakemake->flags);
+	add_args(command, fakemake->objects);
+	add_args(command, fakemake->libraries);
+	finish_command(command);
+
+	return command;
+}
+
+//constructs command to create a static library, ar replaces the whole archive with all of the target's objects
+Command a_compile(Fakemake fakemake)
+{
+	Command command = new_command();
+
+	command->remove = fakemake->name;
+	add_arg(command, "ar");
+	add_arg(command, "rcs");
+	add_arg(command, fakemake->name);
+	add_args(command, fakemake->objects);
+	finish_command(command);
+
+	return command;
 }
 
-//constructs command to compile a .c file from all files necessary and in the specified order
-char* c_compile(Fakemake fakemake, Dllist source)
+Command new_command()
 {
-	//all .c compilations begin with "gcc -c "
-	char* command = malloc(8);
-	strcpy(command,	"gcc -c ");
-	
-	//add all flags to the end of the string separated by whitespace
-	Dllist flag;
-	dll_traverse(flag, fakemake->flags)
-	{
-		command = add_string(command, flag->val.s);
-	}
-	
-	//last string to be printed is the .c file name
-	command = add_string(command, source->val.s);
-	
+	Command command = malloc(sizeof(struct Command));
+
+	command->size = 16;
+	command->argc = 0;
+	command->argv = malloc(command->size * sizeof(char*));
+	command->remove = NULL;
+	command->line = NULL;
+
 	return command;
 }
 
-//constructs command to compile an executable from all strings necessary and in the specified order
-char* e_compile(Fakemake fakemake, Dllist next_string)
+//adds one argument to the end of a command, argv doubles in size when it fills up
+void add_arg(Command command, char* arg)
+{
+	//one slot is always kept for the NULL at the end
+	if(command->argc + 1 == command->size)
+	{
+		command->size *= 2;
+		command->argv = realloc(command->argv, command->size * sizeof(char*));
+	}
+	command->argv[command->argc++] = arg;
+}
+
+void add_args(Command command, Dllist args)
 {
-	//all executable compilations begin with "gcc -o "
-	char* command = malloc(8);
-	strcpy(command, "gcc -o ");
+	Dllist tmp;
 
-	//first string after -o is the executable name
-	command = add_string(command, fakemake->name);
-	
-	//then all flags
-	dll_traverse(next_string, fakemake->flags)
+	dll_traverse(tmp, args)
 	{
-		command = add_string(command, next_string->val.s);
+		add_arg(command, tmp->val.s);
 	}
-	
-	//then all .o files corresponding to all .c files
-	dll_traverse(next_string, fakemake->objects)
+}
+
+/* ends argv with NULL and builds the printed command line in one pass. Arguments with characters
+ * the shell would treat specially are single-quoted so the line can be pasted into a shell */
+void finish_command(Command command)
+{
+	int i, size = 1;
+	char* p;
+	char* c;
+
+	command->argv[command->argc] = NULL;
+
+	//worst case every character is a quote that becomes '\''
+	if(command->remove != NULL)
+		size += 4 * strlen(command->remove) + 16;
+	for(i = 0; i < command->argc; i++)
+		size += 4 * strlen(command->argv[i]) + 3;
+
+	command->line = malloc(size);
+	p = command->line;
+	if(command->remove != NULL)
+		p += sprintf(p, "rm -f %s && ", command->remove);
+
+	for(i = 0; i < command->argc; i++)
 	{
-		command = add_string(command, next_string->val.s);
+		if(i > 0)
+			*p++ = ' ';
+		if(command->argv[i][0] != '\0' && strspn(command->argv[i], "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-+=.,/:@%") == strlen(command->argv[i]))
+		{
+			strcpy(p, command->argv[i]);
+			p += strlen(p);
+			continue;
+		}
+
+		*p++ = '\'';
+		for(c = command->argv[i]; *c != '\0'; c++)
+		{
+			if(*c == '\'')
+			{
+				strcpy(p, "'\\''");
+				p += 4;
+			}
+			else
+				*p++ = *c;
+		}
+		*p++ = '\'';
 	}
+	*p = '\0';
+}
 
-	//then all libraries
-	dll_traverse(next_string, fakemake->libraries)
+void free_command(Command command)
+{
+	free(command->argv);
+	free(command->line);
+	free(command);
+}
+
+/* starts a command in a child process with posix_spawnp() without waiting for it and returns its
+ * pid, or -1 if it couldn't be started */
+pid_t start_job(Command command)
+{
+	pid_t pid;
+	int error;
+
+	if(command->remove != NULL && unlink(command->remove) < 0 && errno != ENOENT)
 	{
-		command = add_string(command, next_string->val.s);
+		perror(command->remove);
+		return -1;
 	}
 
-	return command;
+	error = posix_spawnp(&pid, command->argv[0], NULL, NULL, command->argv, environ);
+	if(error != 0)
+	{
+		fprintf(stderr, "%s: %s\n", command->argv[0], strerror(error));
+		return -1;
+	}
+
+	running_jobs++;
+
+	return pid;
 }
 
-//adds a string and a trailing ' ' to another string, i.e. c++ s3 = s1 + s2 + ' '
-char* add_string(char* s1, char* s2)
+//waits for any one running command and returns its pid, ok is set to whether it succeeded
+pid_t wait_job(bool* ok)
 {
-	//memory needed for combined string is the number of characters in both, plus 2. Adding 2 for \0 and one additional ' '
-	int s3_size = strlen(s1) + strlen(s2) + 2;
-	char* s3 = malloc(s3_size);
-	
-	//first copy s1 into the new string, then find the end of that string (\0) and add s2 starting at that position
-	strcpy(s3, s1);
-	strcpy(s3 + strlen(s1), s2);
-	//add the new ' ' and \0 at the end
-	strcpy(s3 + strlen(s1) + strlen(s2), " \0");
-	
-	//s1 is always the last version of command before another string is added, so it needs to be deleted now
-	//s2 is from the Fakemake struct, which will be deleted by free_memory() at the end
-	free(s1);
-
-	return s3;
+	int status;
+	pid_t pid;
+
+	pid = waitpid(-1, &status, 0);
+	if(pid < 0)
+	{
+		running_jobs = 0;
+		*ok = false;
+		return pid;
+	}
+	running_jobs--;
+	*ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+	return pid;
 }
 
-//frees all memory associated with the input file and strings stored within Fakemake struct
+//frees all memory associated with the input file (if is isn't NULL) and strings stored within Fakemake struct
 void free_memory(IS is, Fakemake fakemake)
 {
 	//free all members of fakemake
 	//Dllists are traversed and the string stored in each node is deleted, then the Dllist itself is deleted
 	Dllist tmp;
-	
+
 	free(fakemake->name);
 
 	//sources
@@ -386,15 +1152,16 @@ void free_memory(IS is, Fakemake fakemake)
 		free(tmp->val.s);
 	}
 	free_dllist(fakemake->libraries);
-	
+
 	//objects
 	dll_traverse(tmp, fakemake->objects)
 	{
 		free(tmp->val.s);
 	}
 	free_dllist(fakemake->objects);
-	
+
 	free(fakemake);
-	
-	jettison_inputstruct(is);
+
+	if(is != NULL)
+		jettison_inputstruct(is);
 }
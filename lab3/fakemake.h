@@ -0,0 +1,61 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab3: fakemake.h
+ * Types shared by fakemake.c and the modules that look at its dependency graph.
+ * 09/26/2020 */
+
+#ifndef FAKEMAKE_H
+#define FAKEMAKE_H
+
+#include <stdbool.h>
+#include "dllist.h"
+
+typedef struct Fakemake
+{
+	char* name;
+	char type;
+	Dllist sources;
+	Dllist headers;
+	Dllist flags;
+	Dllist libraries;
+	Dllist objects;
+} *Fakemake;
+
+/* a command as the argument vector passed to posix_spawnp() and the command line printed for it.
+ * The strings in argv belong to the Fakemake and Node it was built from. remove is a file
+ * deleted before the command runs, printed as "rm -f remove && ..." */
+typedef struct Command
+{
+	char** argv;
+	int argc;
+	int size;
+	char* remove;
+	char* line;
+} *Command;
+
+/* one file in the dependency graph. type is 'c' for an object compiled from source, 'e' for an
+ * executable and 'a' for a static library. target is the Fakemake whose flags and headers build it.
+ * start and end are when its command ran (microseconds into the build, -1 if it didn't) and lane
+ * is which of the -j slots ran it, path_time and path_next are filled in by trace_report() */
+typedef struct Node
+{
+	char* name;
+	char type;
+	char* source;
+	char* depfile;
+	Command command;
+	Fakemake target;
+	Dllist dependents;
+	int waiting;
+	bool rebuilt;
+	bool dependency_rebuilt;
+	bool done;
+	int lane;
+	long start;
+	long end;
+	bool cached;
+	long path_time;
+	struct Node* path_next;
+} *Node;
+
+#endif
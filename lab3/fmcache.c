@@ -0,0 +1,395 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab3: fmcache.c
+ * Implementation of the build cache in fmcache.h. The cache directory holds one directory per
+ * compile, named by the hash of the .c file's contents and the command. Inside it, each entry is
+ * three files sharing a name (the hash of the entry's manifest):
+ *   <entry>.h - manifest, one "hash path" line per header listed in the depfile
+ *   <entry>.o - the object
+ *   <entry>.d - the depfile
+ * An entry is used when every header in its manifest still has the same contents, so a compile
+ * is only skipped when gcc would have seen exactly the same input. Files are copied in and out
+ * through a temporary name and rename(), so concurrent compiles never see half-written files,
+ * and copies are reflinks on filesystems that support them.
+ * Hashes are 128 bits: two 64-bit FNV-1a hashes with different offset bases.
+ * read_depfile() is here because the manifest is made from a depfile, and fakemake.c uses the
+ * same parser for the headers that decide whether an object is stale.
+ * 09/26/2020 */
+
+#include "fmcache.h"
+#include "dllist.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#define FNV_PRIME 1099511628211UL
+
+//NULL when the cache is off
+static char* cache_dir = NULL;
+
+static void hash_bytes(unsigned long* h, const char* data, long size);
+static void hash_hex(unsigned long* h, char* hex);
+static char* entry_dir(char* source, char* command);
+static char* make_manifest(char* depfile);
+static bool manifest_matches(char* manifest_path);
+
+void cache_init(char* dir)
+{
+	cache_dir = dir;
+	mkdir(cache_dir, 0777);
+}
+
+//restores object and depfile from the cache if an entry matches, returns false on a miss
+bool cache_restore(char* source, char* command, char* object, char* depfile)
+{
+	DIR* d;
+	struct dirent* de;
+	char* dir;
+	char* path;
+	char* base;
+	bool restored = false;
+	int len;
+
+	if(cache_dir == NULL)
+		return false;
+	dir = entry_dir(source, command);
+	if(dir == NULL)
+		return false;
+
+	d = opendir(dir);
+	if(d == NULL)
+	{
+		free(dir);
+		return false;
+	}
+
+	path = malloc(strlen(dir) + 256 + 3);
+	base = malloc(strlen(dir) + 256 + 3);
+	for(de = readdir(d); de != NULL && !restored; de = readdir(d))
+	{
+		len = strlen(de->d_name);
+		if(len < 3 || strcmp(de->d_name + len - 2, ".h") != 0)
+			continue;
+
+		sprintf(path, "%s/%s", dir, de->d_name);
+		if(!manifest_matches(path))
+			continue;
+
+		//same entry name with .o and .d instead of .h
+		sprintf(base, "%s/%.*s", dir, len - 2, de->d_name);
+		sprintf(path, "%s.o", base);
+		if(!copy_file(path, object))
+			continue;
+		sprintf(path, "%s.d", base);
+		restored = copy_file(path, depfile);
+	}
+	closedir(d);
+
+	free(path);
+	free(base);
+	free(dir);
+
+	return restored;
+}
+
+//adds the object and depfile of a compile that just succeeded to the cache
+void cache_store(char* source, char* command, char* object, char* depfile)
+{
+	char* dir;
+	char* manifest;
+	char* path;
+	char* tmp;
+	char entry[HASH_HEX];
+	FILE* f;
+
+	if(cache_dir == NULL)
+		return;
+	dir = entry_dir(source, command);
+	if(dir == NULL)
+		return;
+	manifest = make_manifest(depfile);
+	if(manifest == NULL)
+	{
+		free(dir);
+		return;
+	}
+
+	mkdir(dir, 0777);
+	hash_string(manifest, entry);
+	path = malloc(strlen(dir) + HASH_HEX + 8);
+	tmp = malloc(strlen(dir) + HASH_HEX + 32);
+
+	//object and depfile go in before the manifest, an entry isn't used until its manifest exists
+	sprintf(path, "%s/%s.o", dir, entry);
+	if(copy_file(object, path))
+	{
+		sprintf(path, "%s/%s.d", dir, entry);
+		if(copy_file(depfile, path))
+		{
+			sprintf(path, "%s/%s.h", dir, entry);
+			sprintf(tmp, "%s.tmp%d", path, getpid());
+			f = fopen(tmp, "w");
+			if(f != NULL)
+			{
+				fputs(manifest, f);
+				if(fclose(f) == 0)
+					rename(tmp, path);
+				else
+					unlink(tmp);
+			}
+		}
+	}
+
+	free(path);
+	free(tmp);
+	free(manifest);
+	free(dir);
+}
+
+//hex hash of a file's contents, false if it can't be read
+bool hash_file(char* path, char* hex)
+{
+	unsigned long h[2] = {14695981039346656037UL, 0x6c62272e07bb0142UL};
+	char block[65536];
+	ssize_t n;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return false;
+	while((n = read(fd, block, sizeof(block))) > 0)
+		hash_bytes(h, block, n);
+	close(fd);
+	if(n < 0)
+		return false;
+
+	hash_hex(h, hex);
+
+	return true;
+}
+
+//hex hash of a string
+void hash_string(char* s, char* hex)
+{
+	unsigned long h[2] = {14695981039346656037UL, 0x6c62272e07bb0142UL};
+
+	hash_bytes(h, s, strlen(s));
+	hash_hex(h, hex);
+}
+
+/* copies from to to, replacing to atomically. A reflink (FICLONE) is tried first so the copy
+ * shares blocks with the original where the filesystem allows it */
+bool copy_file(char* from, char* to)
+{
+	char block[65536];
+	char* tmp;
+	int in, out;
+	ssize_t n;
+	bool ok = true;
+	struct stat fileStat;
+
+	in = open(from, O_RDONLY);
+	if(in < 0)
+		return false;
+	fstat(in, &fileStat);
+
+	tmp = malloc(strlen(to) + 32);
+	sprintf(tmp, "%s.tmp%d", to, getpid());
+	out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, fileStat.st_mode & 0777);
+	if(out < 0)
+	{
+		close(in);
+		free(tmp);
+		return false;
+	}
+
+#ifdef FICLONE
+	if(ioctl(out, FICLONE, in) < 0)
+#endif
+	{
+		while(ok && (n = read(in, block, sizeof(block))) > 0)
+		{
+			if(write(out, block, n) != n)
+				ok = false;
+		}
+		if(n < 0)
+			ok = false;
+	}
+
+	close(in);
+	if(close(out) < 0)
+		ok = false;
+
+	if(ok)
+		ok = (rename(tmp, to) == 0);
+	if(!ok)
+		unlink(tmp);
+	free(tmp);
+
+	return ok;
+}
+
+/* reads the prerequisites out of a depfile written by gcc -MMD, which looks like
+ *   file.o: file.c header1.h \
+ *    header2.h
+ * and returns every prerequisite after the source as a list of strings, or NULL if the depfile
+ * can't be read */
+Dllist read_depfile(char* depfile)
+{
+	FILE* f;
+	Dllist headers;
+	char* contents;
+	char* word;
+	struct stat fileStat;
+	int i, words = 0;
+
+	f = fopen(depfile, "r");
+	if(f == NULL)
+		return NULL;
+	if(fstat(fileno(f), &fileStat) < 0)
+	{
+		fclose(f);
+		return NULL;
+	}
+
+	contents = malloc(fileStat.st_size + 1);
+	contents[fread(contents, 1, fileStat.st_size, f)] = '\0';
+	fclose(f);
+
+	//line continuations are just whitespace
+	for(i = 0; contents[i] != '\0'; i++)
+	{
+		if(contents[i] == '\\' && contents[i + 1] == '\n')
+			contents[i] = ' ';
+	}
+
+	//first word is the object with a ':' and the second is the .c file
+	headers = new_dllist();
+	for(word = strtok(contents, " \t\n"); word != NULL; word = strtok(NULL, " \t\n"))
+	{
+		if(words++ >= 2)
+			dll_append(headers, new_jval_s(strdup(word)));
+	}
+	free(contents);
+
+	return headers;
+}
+
+//two FNV-1a hashes in one pass
+static void hash_bytes(unsigned long* h, const char* data, long size)
+{
+	long i;
+
+	for(i = 0; i < size; i++)
+	{
+		h[0] = (h[0] ^ (unsigned char) data[i]) * FNV_PRIME;
+		h[1] = (h[1] ^ (unsigned char) data[i]) * FNV_PRIME;
+	}
+}
+
+static void hash_hex(unsigned long* h, char* hex)
+{
+	sprintf(hex, "%016lx%016lx", h[0], h[1]);
+}
+
+//directory for a compile: hash of the source contents, a '\0', then the command
+static char* entry_dir(char* source, char* command)
+{
+	unsigned long h[2] = {14695981039346656037UL, 0x6c62272e07bb0142UL};
+	char block[65536];
+	char hex[HASH_HEX];
+	char* dir;
+	ssize_t n;
+	int fd;
+
+	fd = open(source, O_RDONLY);
+	if(fd < 0)
+		return NULL;
+	while((n = read(fd, block, sizeof(block))) > 0)
+		hash_bytes(h, block, n);
+	close(fd);
+	if(n < 0)
+		return NULL;
+	hash_bytes(h, "", 1);
+	hash_bytes(h, command, strlen(command));
+	hash_hex(h, hex);
+
+	dir = malloc(strlen(cache_dir) + HASH_HEX + 2);
+	sprintf(dir, "%s/%s", cache_dir, hex);
+
+	return dir;
+}
+
+//"hash path" lines for every header in a depfile, NULL if the depfile or a header can't be read
+static char* make_manifest(char* depfile)
+{
+	Dllist headers, tmp;
+	char hex[HASH_HEX];
+	char* manifest;
+	int size = 1;
+	bool ok = true;
+
+	headers = read_depfile(depfile);
+	if(headers == NULL)
+		return NULL;
+
+	dll_traverse(tmp, headers)
+	{
+		size += HASH_HEX + strlen(tmp->val.s) + 1;
+	}
+	manifest = malloc(size);
+	manifest[0] = '\0';
+
+	dll_traverse(tmp, headers)
+	{
+		if(ok && hash_file(tmp->val.s, hex))
+			sprintf(manifest + strlen(manifest), "%s %s\n", hex, tmp->val.s);
+		else
+			ok = false;
+		free(tmp->val.s);
+	}
+	free_dllist(headers);
+
+	if(!ok)
+	{
+		free(manifest);
+		return NULL;
+	}
+
+	return manifest;
+}
+
+//true if every header in a manifest still hashes to what it did when the entry was stored
+static bool manifest_matches(char* manifest_path)
+{
+	FILE* f;
+	char line[4096 + HASH_HEX + 2];
+	char hex[HASH_HEX];
+	int len;
+	bool matches = true;
+
+	f = fopen(manifest_path, "r");
+	if(f == NULL)
+		return false;
+
+	while(matches && fgets(line, sizeof(line), f) != NULL)
+	{
+		len = strlen(line);
+		if(line[len - 1] == '\n')
+			line[len - 1] = '\0';
+		if(len < HASH_HEX + 1 || line[HASH_HEX - 1] != ' ')
+			matches = false;
+		else if(!hash_file(line + HASH_HEX, hex) || strncmp(hex, line, HASH_HEX - 1) != 0)
+			matches = false;
+	}
+	fclose(f);
+
+	return matches;
+}
@@ -0,0 +1,27 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab3: fmcache.h
+ * Content-addressed build cache for fakemake. A compile is identified by the contents of its
+ * .c file and the exact command line; every set of header contents it has been compiled
+ * against is stored as a separate entry holding the object and depfile gcc produced. See
+ * fmcache.c for the layout on disk.
+ * 09/26/2020 */
+
+#ifndef FMCACHE_H
+#define FMCACHE_H
+
+#include <stdbool.h>
+#include "dllist.h"
+
+//length of a hash written as hex, plus '\0'
+#define HASH_HEX 33
+
+void cache_init(char* dir);
+bool cache_restore(char* source, char* command, char* object, char* depfile);
+void cache_store(char* source, char* command, char* object, char* depfile);
+bool hash_file(char* path, char* hex);
+void hash_string(char* s, char* hex);
+bool copy_file(char* from, char* to);
+Dllist read_depfile(char* depfile);
+
+#endif
@@ -0,0 +1,386 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab3: fmstate.c
+ * Implementation of the build state in fmstate.h. The state file is text, one record per line:
+ *   fakemake-state 1                          first line, anything else means no state
+ *   F <mtime_ns> <size> <hash> <path>         content hash of a file
+ *   O <mtime_ns> <size> <signature> <path>    an object as it was after it was built
+ *   D <path>                                  a header of the O record above it
+ * It is written to a temporary file and renamed over the old one, so a run that is interrupted
+ * leaves the last complete state behind.
+ * Paths added with stat_add() are stat()ed by stat_all() with a pool of threads, since on a
+ * network filesystem each stat() is a round trip and a no-op build is mostly waiting on them.
+ * 09/26/2020 */
+
+#include "fmstate.h"
+#include "fields.h"
+#include "jrb.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define STATE_VERSION "fakemake-state 1"
+
+//most threads stat_all() uses, and about how many files each thread should get at least
+#define STAT_THREADS 16
+#define STAT_PER_THREAD 64
+
+//path -> FileInfo and object path -> Output
+static JRB files = NULL;
+static JRB outputs = NULL;
+
+//FileInfos waiting for stat_all()
+static Dllist pending = NULL;
+
+typedef struct StatJob
+{
+	FileInfo* infos;
+	int count;
+	int first;
+	int step;
+} *StatJob;
+
+static void init();
+static FileInfo new_info(char* path);
+static void do_stat(FileInfo info);
+static void* stat_thread(void* arg);
+
+//reads the state file if there is one, a missing or unreadable state file just means no state
+void state_load(char* path)
+{
+	IS is;
+	FileInfo info;
+	Output output = NULL;
+	JRB found;
+
+	init();
+	is = new_inputstruct(path);
+	if(is == NULL)
+		return;
+
+	if(get_line(is) < 0 || strncmp(is->text1, STATE_VERSION, strlen(STATE_VERSION)) != 0)
+	{
+		jettison_inputstruct(is);
+		return;
+	}
+
+	while(get_line(is) >= 0)
+	{
+		if(strcmp(is->fields[0], "F") == 0 && is->NF == 5 && strlen(is->fields[3]) == HASH_HEX - 1)
+		{
+			found = jrb_find_str(files, is->fields[4]);
+			info = (found != NULL) ? (FileInfo) found->val.v : new_info(is->fields[4]);
+			info->hashed = true;
+			info->hash_mtime_ns = atol(is->fields[1]);
+			info->hash_size = atol(is->fields[2]);
+			strcpy(info->hash, is->fields[3]);
+		}
+		else if(strcmp(is->fields[0], "O") == 0 && is->NF == 5 && strlen(is->fields[3]) == HASH_HEX - 1)
+		{
+			output = malloc(sizeof(struct Output));
+			output->path = strdup(is->fields[4]);
+			output->mtime_ns = atol(is->fields[1]);
+			output->size = atol(is->fields[2]);
+			strcpy(output->signature, is->fields[3]);
+			output->headers = new_dllist();
+			jrb_insert_str(outputs, output->path, new_jval_v(output));
+		}
+		else if(strcmp(is->fields[0], "D") == 0 && is->NF == 2 && output != NULL)
+			dll_append(output->headers, new_jval_s(strdup(is->fields[1])));
+	}
+
+	jettison_inputstruct(is);
+}
+
+//writes every known hash and object record, returns false if the state file couldn't be written
+bool state_save(char* path)
+{
+	FILE* f;
+	JRB tmp;
+	Dllist header;
+	FileInfo info;
+	Output output;
+	char* tmp_path;
+	bool ok;
+
+	init();
+	tmp_path = malloc(strlen(path) + 32);
+	sprintf(tmp_path, "%s.tmp%d", path, getpid());
+	f = fopen(tmp_path, "w");
+	if(f == NULL)
+	{
+		free(tmp_path);
+		return false;
+	}
+
+	fprintf(f, "%s\n", STATE_VERSION);
+
+	//hashes of files that are gone aren't worth keeping
+	jrb_traverse(tmp, files)
+	{
+		info = (FileInfo) tmp->val.v;
+		if(info->hashed && (!info->stated || info->exists))
+			fprintf(f, "F %ld %ld %s %s\n", info->hash_mtime_ns, info->hash_size, info->hash, info->path);
+	}
+
+	jrb_traverse(tmp, outputs)
+	{
+		output = (Output) tmp->val.v;
+		fprintf(f, "O %ld %ld %s %s\n", output->mtime_ns, output->size, output->signature, output->path);
+		dll_traverse(header, output->headers)
+		{
+			fprintf(f, "D %s\n", header->val.s);
+		}
+	}
+
+	ok = (fclose(f) == 0);
+	if(ok)
+		ok = (rename(tmp_path, path) == 0);
+	if(!ok)
+		unlink(tmp_path);
+	free(tmp_path);
+
+	return ok;
+}
+
+//queues a path for stat_all(), paths that are already stat()ed or queued are ignored
+void stat_add(char* path)
+{
+	JRB found;
+	FileInfo info;
+
+	init();
+	found = jrb_find_str(files, path);
+	info = (found != NULL) ? (FileInfo) found->val.v : new_info(path);
+	if(!info->stated && !info->queued)
+	{
+		info->queued = true;
+		dll_append(pending, new_jval_v(info));
+	}
+}
+
+//stats everything queued by stat_add(), spread over up to STAT_THREADS threads
+void stat_all()
+{
+	FileInfo* infos;
+	pthread_t threads[STAT_THREADS];
+	struct StatJob jobs[STAT_THREADS];
+	bool created[STAT_THREADS];
+	Dllist tmp;
+	int count = 0, nthreads, i;
+
+	init();
+	dll_traverse(tmp, pending)
+	{
+		count++;
+	}
+
+	//anything file_info() got to first is already done
+	infos = malloc((count + 1) * sizeof(FileInfo));
+	count = 0;
+	dll_traverse(tmp, pending)
+	{
+		((FileInfo) tmp->val.v)->queued = false;
+		if(!((FileInfo) tmp->val.v)->stated)
+			infos[count++] = (FileInfo) tmp->val.v;
+	}
+	free_dllist(pending);
+	pending = new_dllist();
+
+	nthreads = (count + STAT_PER_THREAD - 1) / STAT_PER_THREAD;
+	if(nthreads > STAT_THREADS)
+		nthreads = STAT_THREADS;
+
+	//threads take every nthreads'th file, the first share and any thread that can't be created are done here
+	for(i = 0; i < nthreads; i++)
+	{
+		jobs[i].infos = infos;
+		jobs[i].count = count;
+		jobs[i].first = i;
+		jobs[i].step = nthreads;
+		created[i] = (i > 0 && pthread_create(&threads[i], NULL, stat_thread, &jobs[i]) == 0);
+		if(i > 0 && !created[i])
+			stat_thread(&jobs[i]);
+	}
+	if(nthreads > 0)
+		stat_thread(&jobs[0]);
+	for(i = 1; i < nthreads; i++)
+	{
+		if(created[i])
+			pthread_join(threads[i], NULL);
+	}
+
+	free(infos);
+}
+
+//what stat() said about a file this run, a file that hasn't been stat()ed yet is stat()ed now
+FileInfo file_info(char* path)
+{
+	JRB found;
+	FileInfo info;
+
+	init();
+	found = jrb_find_str(files, path);
+	info = (found != NULL) ? (FileInfo) found->val.v : new_info(path);
+	if(!info->stated)
+		do_stat(info);
+
+	return info;
+}
+
+//stats a file again after a command has rewritten it
+void file_refresh(char* path)
+{
+	do_stat(file_info(path));
+}
+
+//content hash of a file, read only if it changed since it was last hashed. NULL if it can't be read
+char* file_hash(char* path)
+{
+	FileInfo info = file_info(path);
+
+	if(!info->exists)
+		return NULL;
+	if(info->hashed && info->hash_mtime_ns == info->mtime_ns && info->hash_size == info->size)
+		return info->hash;
+
+	if(!hash_file(path, info->hash))
+	{
+		info->hashed = false;
+		return NULL;
+	}
+	info->hashed = true;
+	info->hash_mtime_ns = info->mtime_ns;
+	info->hash_size = info->size;
+
+	return info->hash;
+}
+
+Output find_output(char* path)
+{
+	JRB found;
+
+	init();
+	found = jrb_find_str(outputs, path);
+	if(found == NULL)
+		return NULL;
+
+	return (Output) found->val.v;
+}
+
+//records an object that was just built from its current stat(), headers is kept by the record
+void set_output(char* path, char* signature, Dllist headers)
+{
+	Output output;
+	FileInfo info;
+	Dllist tmp;
+
+	output = find_output(path);
+	if(output == NULL)
+	{
+		output = malloc(sizeof(struct Output));
+		output->path = strdup(path);
+		jrb_insert_str(outputs, output->path, new_jval_v(output));
+	}
+	else
+	{
+		dll_traverse(tmp, output->headers)
+		{
+			free(tmp->val.s);
+		}
+		free_dllist(output->headers);
+	}
+
+	info = file_info(path);
+	output->mtime_ns = info->mtime_ns;
+	output->size = info->size;
+	strcpy(output->signature, signature);
+	output->headers = headers;
+}
+
+//frees the tables, the state file isn't touched
+void state_free()
+{
+	JRB tmp;
+	Dllist header;
+	FileInfo info;
+	Output output;
+
+	if(files == NULL)
+		return;
+
+	jrb_traverse(tmp, files)
+	{
+		info = (FileInfo) tmp->val.v;
+		free(info->path);
+		free(info);
+	}
+	jrb_traverse(tmp, outputs)
+	{
+		output = (Output) tmp->val.v;
+		dll_traverse(header, output->headers)
+		{
+			free(header->val.s);
+		}
+		free_dllist(output->headers);
+		free(output->path);
+		free(output);
+	}
+	jrb_free_tree(files);
+	jrb_free_tree(outputs);
+	free_dllist(pending);
+	files = NULL;
+}
+
+static void init()
+{
+	if(files != NULL)
+		return;
+	files = make_jrb();
+	outputs = make_jrb();
+	pending = new_dllist();
+}
+
+static FileInfo new_info(char* path)
+{
+	FileInfo info = malloc(sizeof(struct FileInfo));
+
+	info->path = strdup(path);
+	info->stated = false;
+	info->queued = false;
+	info->exists = false;
+	info->hashed = false;
+	jrb_insert_str(files, info->path, new_jval_v(info));
+
+	return info;
+}
+
+static void do_stat(FileInfo info)
+{
+	struct stat fileStat;
+
+	info->exists = (stat(info->path, &fileStat) == 0);
+	if(info->exists)
+	{
+		info->mtime = fileStat.st_mtime;
+		info->mtime_ns = fileStat.st_mtim.tv_sec * 1000000000L + fileStat.st_mtim.tv_nsec;
+		info->size = fileStat.st_size;
+	}
+	info->stated = true;
+}
+
+//each thread only writes to its own FileInfos, the table itself isn't touched
+static void* stat_thread(void* arg)
+{
+	StatJob job = (StatJob) arg;
+	int i;
+
+	for(i = job->first; i < job->count; i += job->step)
+		do_stat(job->infos[i]);
+
+	return NULL;
+}
@@ -0,0 +1,57 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab3: fmstate.h
+ * Build state for fakemake. Every file fakemake looks at is stat()ed once per run (most of them
+ * in one parallel pass at the start) and remembered in a table, and the state file keeps, from
+ * one run to the next, the content hash of each file and what every object was built from.
+ * See fmstate.c for the state file format.
+ * 09/26/2020 */
+
+#ifndef FMSTATE_H
+#define FMSTATE_H
+
+#include <stdbool.h>
+#include "dllist.h"
+#include "fmcache.h"
+
+/* one file. exists, mtime (seconds), mtime_ns and size come from this run's stat(). hash is the
+ * content hash of the file when it had hash_mtime_ns and hash_size, so it can be trusted without
+ * reading the file as long as those still match */
+typedef struct FileInfo
+{
+	char* path;
+	bool stated;
+	bool queued;
+	bool exists;
+	long mtime;
+	long mtime_ns;
+	long size;
+	bool hashed;
+	long hash_mtime_ns;
+	long hash_size;
+	char hash[HASH_HEX];
+} *FileInfo;
+
+/* an object as it was after it was last built: its own mtime and size, a signature of the command
+ * and the contents of everything it was compiled from, and the headers it included */
+typedef struct Output
+{
+	char* path;
+	long mtime_ns;
+	long size;
+	char signature[HASH_HEX];
+	Dllist headers;
+} *Output;
+
+void state_load(char* path);
+bool state_save(char* path);
+void state_free();
+void stat_add(char* path);
+void stat_all();
+FileInfo file_info(char* path);
+void file_refresh(char* path);
+char* file_hash(char* path);
+Output find_output(char* path);
+void set_output(char* path, char* signature, Dllist headers);
+
+#endif
@@ -0,0 +1,214 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab3: fmtrace.c
+ * Implementation of the build trace in fmtrace.h. Times are microseconds from trace_init() on the
+ * monotonic clock. In the trace each -j slot is a thread, so the picture shows how busy the
+ * slots were and what they waited on. The critical path is the chain through the graph whose
+ * commands take longest in total: no amount of -j makes a build faster than that, so it's the
+ * chain worth splitting up or caching.
+ * 09/26/2020 */
+
+#include "fmtrace.h"
+#include "jrb.h"
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+//how many compiles trace_report() lists
+#define SLOWEST 10
+
+static long base = 0;
+
+static long duration(Node node);
+static long path_time(Node node);
+static char* category(Node node);
+static void put_json_string(FILE* f, char* s);
+
+//the build starts now
+void trace_init()
+{
+	base = 0;
+	base = trace_now();
+}
+
+long trace_now()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000000L + now.tv_nsec / 1000 - base;
+}
+
+//writes every command that ran as a complete ("X") event, returns false if path can't be written
+bool trace_write(char* path, Dllist order)
+{
+	FILE* f;
+	Dllist tmp;
+	Node node;
+	int lanes = 0, i;
+	bool first = true;
+
+	f = fopen(path, "w");
+	if(f == NULL)
+		return false;
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	dll_traverse(tmp, order)
+	{
+		node = (Node) tmp->val.v;
+		if(node->start < 0)
+			continue;
+		if(node->lane >= lanes)
+			lanes = node->lane + 1;
+
+		fprintf(f, "%s{\"name\":", first ? "" : ",\n");
+		put_json_string(f, node->name);
+		fprintf(f, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%ld,\"dur\":%ld,\"pid\":1,\"tid\":%d,\"args\":{",
+			category(node), node->start, duration(node), node->lane + 1);
+		if(node->command != NULL)
+		{
+			fprintf(f, "\"command\":");
+			put_json_string(f, node->command->line);
+			fprintf(f, ",");
+		}
+		fprintf(f, "\"ok\":%s}}", node->done ? "true" : "false");
+		first = false;
+	}
+
+	//names for the slots
+	for(i = 0; i < lanes; i++)
+	{
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"job %d\"}}",
+			first ? "" : ",\n", i + 1, i + 1);
+		first = false;
+	}
+	fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	return fclose(f) == 0;
+}
+
+/* prints the wall time of the build and how much of it was spent running commands, the critical
+ * path with the time of each step on it, and the slowest compiles */
+void trace_report(Dllist order, FILE* out)
+{
+	Dllist tmp;
+	JRB slowest, found;
+	Node node, longest = NULL;
+	long wall = 0, work = 0;
+	int commands = 0, i;
+
+	dll_traverse(tmp, order)
+	{
+		node = (Node) tmp->val.v;
+		node->path_time = -1;
+		node->path_next = NULL;
+	}
+
+	slowest = make_jrb();
+	dll_traverse(tmp, order)
+	{
+		node = (Node) tmp->val.v;
+		if(longest == NULL || path_time(node) > longest->path_time)
+			longest = node;
+		if(node->start < 0)
+			continue;
+
+		commands++;
+		work += duration(node);
+		if(node->end > wall)
+			wall = node->end;
+		if(node->type == 'c' && !node->cached)
+			jrb_insert_int(slowest, -(int) duration(node), new_jval_v(node));
+	}
+
+	fprintf(out, "build time %.3f s, %d commands, %.3f s of work", wall / 1e6, commands, work / 1e6);
+	if(wall > 0)
+		fprintf(out, " (%.1f running on average)", (double) work / wall);
+	fprintf(out, "\n");
+
+	if(longest != NULL && longest->path_time > 0)
+	{
+		fprintf(out, "critical path %.3f s:\n", longest->path_time / 1e6);
+		for(node = longest; node != NULL; node = node->path_next)
+		{
+			if(node->start >= 0)
+				fprintf(out, "  %8.3f s  %s\n", duration(node) / 1e6, node->name);
+		}
+	}
+
+	if(!jrb_empty(slowest))
+	{
+		fprintf(out, "slowest compiles:\n");
+		i = 0;
+		jrb_traverse(found, slowest)
+		{
+			if(i++ == SLOWEST)
+				break;
+			node = (Node) found->val.v;
+			fprintf(out, "  %8.3f s  %s\n", duration(node) / 1e6, node->source);
+		}
+	}
+	jrb_free_tree(slowest);
+}
+
+static long duration(Node node)
+{
+	if(node->start < 0 || node->end < node->start)
+		return 0;
+
+	return node->end - node->start;
+}
+
+/* longest total time of a chain of commands starting at node and following dependents, remembered
+ * in the node. path_time is set to 0 while a node's dependents are visited so a cycle ends there */
+static long path_time(Node node)
+{
+	Dllist tmp;
+	Node dependent;
+	long best = 0;
+
+	if(node->path_time >= 0)
+		return node->path_time;
+
+	node->path_time = 0;
+	dll_traverse(tmp, node->dependents)
+	{
+		dependent = (Node) tmp->val.v;
+		if(path_time(dependent) > best || node->path_next == NULL)
+		{
+			best = dependent->path_time;
+			node->path_next = dependent;
+		}
+	}
+	node->path_time = duration(node) + best;
+
+	return node->path_time;
+}
+
+static char* category(Node node)
+{
+	if(node->cached)
+		return "cache";
+	if(node->type == 'c')
+		return "compile";
+	if(node->type == 'a')
+		return "archive";
+
+	return "link";
+}
+
+static void put_json_string(FILE* f, char* s)
+{
+	fputc('"', f);
+	for(; *s != '\0'; s++)
+	{
+		if(*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if((unsigned char) *s < 0x20)
+			fprintf(f, "\\u%04x", (unsigned char) *s);
+		else
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
@@ -0,0 +1,22 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab3: fmtrace.h
+ * Build tracing for fakemake. Every command's start and end time is kept in its Node, and after
+ * the build they can be written as a Chrome trace (chrome://tracing or Perfetto) and summed up
+ * as the critical path and the slowest compiles.
+ * 09/26/2020 */
+
+#ifndef FMTRACE_H
+#define FMTRACE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "dllist.h"
+#include "fakemake.h"
+
+void trace_init();
+long trace_now();
+bool trace_write(char* path, Dllist order);
+void trace_report(Dllist order, FILE* out);
+
+#endif
@@ -0,0 +1,208 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab3: fmwatch.c
+ * Implementation of fmwatch.h with inotify. Editors usually save by writing a new file and
+ * renaming it over the old one, which a watch on the file itself would lose track of, so the
+ * directories holding the files are watched instead and events are matched to files by name.
+ * watch_wait() keeps reading for a short while after the first change, so one save (which can be
+ * several events) or a checkout touching many files turns into one rebuild.
+ * 09/26/2020 */
+
+#include "fmwatch.h"
+#include "jrb.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+
+//how long watch_wait() waits for more events after one arrives, in milliseconds
+#define SETTLE_MS 100
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_ATTRIB)
+
+static int fd = -1;
+
+//directory -> watch descriptor, and "wd/name" -> Dllist of the paths watched under that name
+static JRB dirs = NULL;
+static JRB files = NULL;
+
+static char* file_key(int wd, char* name);
+static void read_events(char* buf, ssize_t n, Dllist changed, JRB seen, bool* overflow);
+
+bool watch_init()
+{
+	fd = inotify_init1(IN_CLOEXEC);
+	if(fd < 0)
+	{
+		perror("inotify_init1");
+		return false;
+	}
+	dirs = make_jrb();
+	files = make_jrb();
+
+	return true;
+}
+
+//starts watching a file, files already watched are ignored
+void watch_file(char* path)
+{
+	JRB found;
+	Dllist paths, tmp;
+	char* dir;
+	char* name;
+	char* key;
+	int wd;
+
+	//split into directory and name
+	name = strrchr(path, '/');
+	if(name == NULL)
+	{
+		dir = strdup(".");
+		name = path;
+	}
+	else
+	{
+		dir = strndup(path, name - path);
+		if(dir[0] == '\0')
+		{
+			free(dir);
+			dir = strdup("/");
+		}
+		name++;
+	}
+
+	found = jrb_find_str(dirs, dir);
+	if(found == NULL)
+	{
+		wd = inotify_add_watch(fd, dir, WATCH_EVENTS);
+		if(wd < 0)
+		{
+			perror(dir);
+			free(dir);
+			return;
+		}
+		jrb_insert_str(dirs, dir, new_jval_i(wd));
+	}
+	else
+	{
+		wd = found->val.i;
+		free(dir);
+	}
+
+	key = file_key(wd, name);
+	found = jrb_find_str(files, key);
+	if(found == NULL)
+	{
+		paths = new_dllist();
+		jrb_insert_str(files, key, new_jval_v(paths));
+	}
+	else
+	{
+		free(key);
+		paths = (Dllist) found->val.v;
+		dll_traverse(tmp, paths)
+		{
+			if(strcmp(tmp->val.s, path) == 0)
+				return;
+		}
+	}
+	dll_append(paths, new_jval_s(strdup(path)));
+}
+
+/* waits until watched files change and returns their paths (still owned by the watcher). If
+ * inotify lost events every watched file is returned */
+Dllist watch_wait()
+{
+	char buf[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd pfd;
+	Dllist changed = new_dllist();
+	Dllist paths, tmp;
+	JRB seen = make_jrb();
+	JRB found;
+	ssize_t n;
+	bool overflow = false;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	//the first read blocks, after that keep reading until nothing happens for SETTLE_MS
+	while(dll_empty(changed) && !overflow)
+	{
+		n = read(fd, buf, sizeof(buf));
+		while(n > 0)
+		{
+			read_events(buf, n, changed, seen, &overflow);
+			if(poll(&pfd, 1, SETTLE_MS) <= 0)
+				break;
+			n = read(fd, buf, sizeof(buf));
+		}
+		if(n < 0)
+		{
+			perror("inotify");
+			break;
+		}
+	}
+	jrb_free_tree(seen);
+
+	if(overflow)
+	{
+		free_dllist(changed);
+		changed = new_dllist();
+		jrb_traverse(found, files)
+		{
+			paths = (Dllist) found->val.v;
+			dll_traverse(tmp, paths)
+			{
+				dll_append(changed, tmp->val);
+			}
+		}
+	}
+
+	return changed;
+}
+
+//adds the watched paths named by a buffer of events to changed, each path once
+static void read_events(char* buf, ssize_t n, Dllist changed, JRB seen, bool* overflow)
+{
+	struct inotify_event* event;
+	Dllist paths, tmp;
+	JRB found;
+	char* key;
+	char* p;
+
+	for(p = buf; p < buf + n; p += sizeof(struct inotify_event) + event->len)
+	{
+		event = (struct inotify_event*) p;
+		if(event->mask & IN_Q_OVERFLOW)
+			*overflow = true;
+		if(event->len == 0)
+			continue;
+
+		key = file_key(event->wd, event->name);
+		found = jrb_find_str(files, key);
+		free(key);
+		if(found == NULL)
+			continue;
+
+		paths = (Dllist) found->val.v;
+		dll_traverse(tmp, paths)
+		{
+			if(jrb_find_str(seen, tmp->val.s) == NULL)
+			{
+				jrb_insert_str(seen, tmp->val.s, JNULL);
+				dll_append(changed, tmp->val);
+			}
+		}
+	}
+}
+
+static char* file_key(int wd, char* name)
+{
+	char* key = malloc(strlen(name) + 16);
+
+	sprintf(key, "%d/%s", wd, name);
+
+	return key;
+}
@@ -0,0 +1,18 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab3: fmwatch.h
+ * Watching files for fakemake --watch. Files are added one at a time with watch_file(), and
+ * watch_wait() blocks until some of them change.
+ * 09/26/2020 */
+
+#ifndef FMWATCH_H
+#define FMWATCH_H
+
+#include <stdbool.h>
+#include "dllist.h"
+
+bool watch_init();
+void watch_file(char* path);
+Dllist watch_wait();
+
+#endif
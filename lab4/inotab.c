@@ -0,0 +1,102 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab4: inotab.c
+ * Implementation of the (dev, ino) hash table in inotab.h. Collisions are resolved with linear
+ * probing and the table doubles whenever it would become more than half full, so a probe
+ * sequence stays short. Entries are never removed.
+ * 10/11/2020 */
+
+#include <stdlib.h>
+#include "inotab.h"
+
+#define INITIAL_SIZE 1024
+
+static unsigned long hash_key(dev_t dev, ino_t ino);
+static void grow(Inotab t);
+
+Inotab make_inotab()
+{
+	Inotab t = malloc(sizeof(struct inotab));
+
+	t->size = INITIAL_SIZE;
+	t->count = 0;
+	t->slots = calloc(t->size, sizeof(struct inotab_slot));
+
+	return t;
+}
+
+//returns the slot holding (dev, ino), or NULL if it was never inserted
+Inoslot inotab_find(Inotab t, dev_t dev, ino_t ino)
+{
+	unsigned long i;
+
+	//size is a power of two, so the mask is the same as % size
+	for(i = hash_key(dev, ino) & (t->size - 1); t->slots[i].used; i = (i + 1) & (t->size - 1))
+	{
+		if(t->slots[i].ino == ino && t->slots[i].dev == dev)
+			return &t->slots[i];
+	}
+
+	return NULL;
+}
+
+//adds (dev, ino) with the given value and returns its slot. The key must not already be in the table
+Inoslot inotab_insert(Inotab t, dev_t dev, ino_t ino, Jval val)
+{
+	unsigned long i;
+
+	if(2 * (t->count + 1) > t->size)
+		grow(t);
+
+	for(i = hash_key(dev, ino) & (t->size - 1); t->slots[i].used; i = (i + 1) & (t->size - 1));
+
+	t->slots[i].dev = dev;
+	t->slots[i].ino = ino;
+	t->slots[i].val = val;
+	t->slots[i].used = 1;
+	t->count++;
+
+	return &t->slots[i];
+}
+
+//frees the table only, values are owned by the caller
+void inotab_free(Inotab t)
+{
+	free(t->slots);
+	free(t);
+}
+
+//inode numbers are often sequential, so mix all the bits before masking (splitmix64 finalizer)
+static unsigned long hash_key(dev_t dev, ino_t ino)
+{
+	unsigned long h = (unsigned long) ino ^ ((unsigned long) dev * 0x9e3779b97f4a7c15UL);
+
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9UL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebUL;
+	h ^= h >> 31;
+
+	return h;
+}
+
+//doubles the table and reinserts every entry
+static void grow(Inotab t)
+{
+	Inoslot old = t->slots;
+	long old_size = t->size, i;
+	unsigned long j;
+
+	t->size *= 2;
+	t->slots = calloc(t->size, sizeof(struct inotab_slot));
+
+	for(i = 0; i < old_size; i++)
+	{
+		if(!old[i].used)
+			continue;
+		for(j = hash_key(old[i].dev, old[i].ino) & (t->size - 1); t->slots[j].used; j = (j + 1) & (t->size - 1));
+		t->slots[j] = old[i];
+	}
+
+	free(old);
+}
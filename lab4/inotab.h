@@ -0,0 +1,35 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab4: inotab.h
+ * Open-addressing hash table keyed on (st_dev, st_ino) used by tarc and tarx to find hard links.
+ * Lookups are O(1) instead of O(log n) in a red-black tree, and keying on the device as well as
+ * the inode keeps files on different mounts from being mistaken for links of each other.
+ * 10/11/2020 */
+
+#ifndef INOTAB_H
+#define INOTAB_H
+
+#include <sys/types.h>
+#include "jval.h"
+
+typedef struct inotab_slot
+{
+	dev_t dev;
+	ino_t ino;
+	Jval val;
+	int used;
+} *Inoslot;
+
+typedef struct inotab
+{
+	long size;
+	long count;
+	Inoslot slots;
+} *Inotab;
+
+Inotab make_inotab();
+Inoslot inotab_find(Inotab t, dev_t dev, ino_t ino);
+Inoslot inotab_insert(Inotab t, dev_t dev, ino_t ino, Jval val);
+void inotab_free(Inotab t);
+
+#endif
@@ -0,0 +1,611 @@
+/* Author: Zachery Creech
+ * COSC360 Fall 2020
+ * Lab4: tarbench.c
+ * Benchmark for tarc and tarx. "tarbench gen <dir> <kind> [scale]" generates a synthetic
+ * directory tree of one of these kinds:
+ *   tiny  - many files of at most 512 bytes spread over 100 directories
+ *   huge  - a few files of 32MB each
+ *   deep  - 200 nested directories with a small file at every level
+ *   links - files with three hard links each, in different directories
+ *   dups  - copies of the same "build outputs" under many directories (for tarc -d)
+ * scale multiplies the number of files (or the file size for huge). Contents are pseudo-random
+ * and deterministic, so trees generated twice are identical.
+ * "tarbench run <dir> [tarc options ...]" runs "tarc <options> <dir> | tarx" in a scratch
+ * directory, checks that the extracted tree is byte-for-byte the same as the original (contents,
+ * modes and hard links), and reports wall time, MB/s, files/s, archive size and the peak RSS of
+ * tarc and tarx. tarc and tarx are taken from the directory tarbench is run from.
+ * "tarbench retype <dir>" checks incremental archives across paths that change type: in a scratch
+ * tree under dir, a directory becomes a file and a file becomes a directory in one incremental
+ * and back again in the next, and extracting the base and both incrementals in order has to give
+ * the final tree.
+ * 10/11/2020 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <signal.h>
+
+//totals for a tree, filled in by count_tree()
+typedef struct tree_stats
+{
+	long files;
+	long bytes;
+} Stats;
+
+void generate(char* dir, char* kind, int scale);
+void make_file(char* path, long size, unsigned long seed);
+void make_dir(char* path);
+void count_tree(char* path, Stats* stats);
+int compare_trees(char* a, char* b);
+int compare_files(char* a, char* b);
+int run(char* dir, char** tarc_args, int nargs);
+int retype(char* dir);
+void swap_types(char* src, int round);
+int run_tool(char** argv, char* in, char* out, char* cwd);
+pid_t spawn(char** argv, int in, int out, char* cwd);
+double now();
+
+int main(int argc, char** argv)
+{
+	int scale = 1;
+
+	if(argc >= 4 && strcmp(argv[1], "gen") == 0)
+	{
+		if(argc > 4)
+			scale = atoi(argv[4]);
+		if(scale < 1)
+			scale = 1;
+		generate(argv[2], argv[3], scale);
+		return 0;
+	}
+	if(argc >= 3 && strcmp(argv[1], "run") == 0)
+		return run(argv[2], argv + 3, argc - 3);
+	if(argc == 3 && strcmp(argv[1], "retype") == 0)
+		return retype(argv[2]);
+
+	fprintf(stderr, "usage: %s gen <dir> tiny|huge|deep|links|dups [scale]\n", argv[0]);
+	fprintf(stderr, "       %s run <dir> [tarc options ...]\n", argv[0]);
+	fprintf(stderr, "       %s retype <dir>\n", argv[0]);
+	return 1;
+}
+
+//creates dir and fills it with a tree of the given kind, an existing dir is left alone
+void generate(char* dir, char* kind, int scale)
+{
+	char path[PATH_MAX], link_path[PATH_MAX + 32];
+	struct stat buf;
+	int i, j, len;
+
+	if(stat(dir, &buf) == 0)
+	{
+		printf("%s already exists, not regenerating\n", dir);
+		return;
+	}
+	make_dir(dir);
+
+	if(strcmp(kind, "tiny") == 0)
+	{
+		for(i = 0; i < 100; i++)
+		{
+			sprintf(path, "%s/d%d", dir, i);
+			make_dir(path);
+			for(j = 0; j < 200 * scale; j++)
+			{
+				sprintf(path, "%s/d%d/f%d", dir, i, j);
+				make_file(path, (i * 7919 + j * 104729) % 513, i * 100000 + j);
+			}
+		}
+	}
+	else if(strcmp(kind, "huge") == 0)
+	{
+		for(i = 0; i < 4; i++)
+		{
+			sprintf(path, "%s/huge%d", dir, i);
+			make_file(path, 32L * 1024 * 1024 * scale, i);
+		}
+	}
+	else if(strcmp(kind, "deep") == 0)
+	{
+		len = sprintf(path, "%s", dir);
+		for(i = 0; i < 200 * scale && len < PATH_MAX - 32; i++)
+		{
+			len += sprintf(path + len, "/d");
+			make_dir(path);
+			sprintf(link_path, "%s/f", path);
+			make_file(link_path, 4096, i);
+		}
+	}
+	else if(strcmp(kind, "links") == 0)
+	{
+		for(i = 0; i < 3; i++)
+		{
+			sprintf(path, "%s/l%d", dir, i);
+			make_dir(path);
+		}
+		for(j = 0; j < 5000 * scale; j++)
+		{
+			sprintf(path, "%s/l0/f%d", dir, j);
+			make_file(path, 1024 + j % 4096, j);
+			for(i = 1; i < 3; i++)
+			{
+				sprintf(link_path, "%s/l%d/f%d", dir, i, j);
+				if(link(path, link_path) < 0)
+				{
+					perror(link_path);
+					exit(1);
+				}
+			}
+		}
+	}
+	else if(strcmp(kind, "dups") == 0)
+	{
+		//every build directory has the same ten objects, and one that differs
+		for(i = 0; i < 50 * scale; i++)
+		{
+			sprintf(path, "%s/build%d", dir, i);
+			make_dir(path);
+			for(j = 0; j < 10; j++)
+			{
+				sprintf(path, "%s/build%d/obj%d.o", dir, i, j);
+				make_file(path, 64 * 1024 + j * 1000, j);
+			}
+			sprintf(path, "%s/build%d/version", dir, i);
+			make_file(path, 256, 1000 + i);
+		}
+	}
+	else
+	{
+		fprintf(stderr, "unknown kind %s\n", kind);
+		exit(1);
+	}
+}
+
+//writes size pseudo-random bytes (xorshift64) to a new file
+void make_file(char* path, long size, unsigned long seed)
+{
+	FILE* f;
+	unsigned long x = seed * 0x9e3779b97f4a7c15UL + 1;
+	char block[8192];
+	long written, n, i;
+
+	f = fopen(path, "w");
+	if(f == NULL)
+	{
+		perror(path);
+		exit(1);
+	}
+
+	for(written = 0; written < size; written += n)
+	{
+		n = (size - written < sizeof(block)) ? size - written : sizeof(block);
+		for(i = 0; i < n; i++)
+		{
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			block[i] = x;
+		}
+		fwrite(block, 1, n, f);
+	}
+
+	fclose(f);
+}
+
+void make_dir(char* path)
+{
+	if(mkdir(path, 0755) < 0)
+	{
+		perror(path);
+		exit(1);
+	}
+}
+
+//counts every entry under path (including path) and the bytes in regular files, hard links count once per name
+void count_tree(char* path, Stats* stats)
+{
+	DIR* d;
+	struct dirent* de;
+	struct stat buf;
+	char child[PATH_MAX];
+
+	if(lstat(path, &buf) < 0)
+		return;
+	stats->files++;
+	if(!S_ISDIR(buf.st_mode))
+	{
+		stats->bytes += buf.st_size;
+		return;
+	}
+
+	d = opendir(path);
+	if(d == NULL)
+		return;
+	for(de = readdir(d); de != NULL; de = readdir(d))
+	{
+		if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		snprintf(child, PATH_MAX, "%s/%s", path, de->d_name);
+		count_tree(child, stats);
+	}
+	closedir(d);
+}
+
+/* returns 0 if the trees at a and b have the same names, types, modes, link counts and file
+ * contents, otherwise prints the first difference and returns 1 */
+int compare_trees(char* a, char* b)
+{
+	DIR* d;
+	struct dirent* de;
+	struct stat abuf, bbuf;
+	char achild[PATH_MAX], bchild[PATH_MAX];
+	long entries = 0;
+
+	if(lstat(a, &abuf) < 0 || lstat(b, &bbuf) < 0)
+	{
+		fprintf(stderr, "missing: %s\n", b);
+		return 1;
+	}
+	if(abuf.st_mode != bbuf.st_mode)
+	{
+		fprintf(stderr, "mode differs: %s\n", b);
+		return 1;
+	}
+	if(!S_ISDIR(abuf.st_mode))
+	{
+		if(abuf.st_nlink != bbuf.st_nlink)
+		{
+			fprintf(stderr, "link count differs: %s\n", b);
+			return 1;
+		}
+		if(abuf.st_size != bbuf.st_size || compare_files(a, b) != 0)
+		{
+			fprintf(stderr, "contents differ: %s\n", b);
+			return 1;
+		}
+		return 0;
+	}
+
+	d = opendir(a);
+	if(d == NULL)
+		return 1;
+	for(de = readdir(d); de != NULL; de = readdir(d))
+	{
+		if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		snprintf(achild, PATH_MAX, "%s/%s", a, de->d_name);
+		snprintf(bchild, PATH_MAX, "%s/%s", b, de->d_name);
+		if(compare_trees(achild, bchild) != 0)
+		{
+			closedir(d);
+			return 1;
+		}
+		entries++;
+	}
+	closedir(d);
+
+	//every name in a is in b, so b has nothing extra if the counts match
+	d = opendir(b);
+	for(de = readdir(d); de != NULL; de = readdir(d))
+	{
+		if(strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0)
+			entries--;
+	}
+	closedir(d);
+	if(entries != 0)
+	{
+		fprintf(stderr, "extra entries in %s\n", b);
+		return 1;
+	}
+
+	return 0;
+}
+
+//0 if files a and b hold the same bytes, compare_trees() has already checked that their sizes match
+int compare_files(char* a, char* b)
+{
+	FILE *fa, *fb;
+	char ablock[65536], bblock[65536];
+	size_t n;
+	int differ = 0;
+
+	fa = fopen(a, "rb");
+	fb = fopen(b, "rb");
+	if(fa == NULL || fb == NULL)
+		differ = 1;
+
+	while(!differ && (n = fread(ablock, 1, sizeof(ablock), fa)) > 0)
+	{
+		if(fread(bblock, 1, n, fb) != n || memcmp(ablock, bblock, n) != 0)
+			differ = 1;
+	}
+
+	if(fa != NULL)
+		fclose(fa);
+	if(fb != NULL)
+		fclose(fb);
+
+	return differ;
+}
+
+/* runs tarc on dir with its output going both into tarx (extracting into a scratch directory)
+ * and through a counter for the archive size, then verifies and reports */
+int run(char* dir, char** tarc_args, int nargs)
+{
+	char src[PATH_MAX], tarc[PATH_MAX], tarx[PATH_MAX], out[PATH_MAX + 8], extracted[PATH_MAX * 2 + 8], command[PATH_MAX * 3];
+	char block[65536];
+	char** argv;
+	int to_tee[2], to_tarx[2], status, ok, i;
+	long archive_size = 0;
+	ssize_t n;
+	pid_t tarc_pid, tarx_pid, pid;
+	struct rusage usage;
+	long tarc_rss = 0, tarx_rss = 0;
+	double start, elapsed;
+	Stats stats = {0, 0};
+
+	if(realpath(dir, src) == NULL || realpath("tarc", tarc) == NULL || realpath("tarx", tarx) == NULL)
+	{
+		perror("realpath (run tarbench from the directory with tarc and tarx)");
+		return 1;
+	}
+	count_tree(src, &stats);
+
+	snprintf(out, sizeof(out), "%s.out", src);
+	snprintf(command, sizeof(command), "rm -rf '%s'", out);
+	system(command);
+	make_dir(out);
+	snprintf(extracted, sizeof(extracted), "%s/%s", out, strrchr(src, '/') + 1);
+
+	argv = malloc((nargs + 3) * sizeof(char*));
+	argv[0] = tarc;
+	for(i = 0; i < nargs; i++)
+		argv[i + 1] = tarc_args[i];
+	argv[nargs + 1] = src;
+	argv[nargs + 2] = NULL;
+
+	//tarc -> this process (counting bytes) -> tarx
+	pipe(to_tee);
+	pipe(to_tarx);
+
+	start = now();
+	tarc_pid = spawn(argv, -1, to_tee[1], NULL);
+	argv[0] = tarx;
+	argv[1] = NULL;
+	tarx_pid = spawn(argv, to_tarx[0], -1, out);
+	close(to_tee[1]);
+	close(to_tarx[0]);
+
+	//if tarx dies early, keep counting so tarc can still finish and its status is reported
+	signal(SIGPIPE, SIG_IGN);
+	while((n = read(to_tee[0], block, sizeof(block))) > 0)
+	{
+		archive_size += n;
+		if(to_tarx[1] != -1 && write(to_tarx[1], block, n) != n)
+		{
+			close(to_tarx[1]);
+			to_tarx[1] = -1;
+		}
+	}
+	close(to_tee[0]);
+	if(to_tarx[1] != -1)
+		close(to_tarx[1]);
+
+	ok = 1;
+	for(i = 0; i < 2; i++)
+	{
+		pid = wait4(-1, &status, 0, &usage);
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			ok = 0;
+		//ru_maxrss is in kilobytes on Linux
+		if(pid == tarc_pid)
+			tarc_rss = usage.ru_maxrss;
+		else if(pid == tarx_pid)
+			tarx_rss = usage.ru_maxrss;
+	}
+	elapsed = now() - start;
+	free(argv);
+
+	if(!ok)
+		fprintf(stderr, "tarc or tarx failed\n");
+	else if(compare_trees(src, extracted) != 0)
+		ok = 0;
+
+	printf("%-24s", strrchr(src, '/') + 1);
+	for(i = 0; i < nargs; i++)
+		printf(" %s", tarc_args[i]);
+	printf("\n  %ld files, %.1f MB, archive %.1f MB\n", stats.files, stats.bytes / 1048576.0, archive_size / 1048576.0);
+	printf("  %.3f s, %.1f MB/s, %.0f files/s\n", elapsed, stats.bytes / 1048576.0 / elapsed, stats.files / elapsed);
+	printf("  peak RSS: tarc %ld KB, tarx %ld KB\n", tarc_rss, tarx_rss);
+	printf("  round trip: %s\n", ok ? "identical" : "FAILED");
+
+	snprintf(command, sizeof(command), "rm -rf '%s'", out);
+	system(command);
+
+	return !ok;
+}
+
+/* makes src with a directory x (holding a file and a subdirectory) and a file y, archives it with
+ * tarc -s, then twice swaps the types of x and y and makes an incremental with tarc -g. The base
+ * and both incrementals are extracted in order by one tarx and compared with src */
+int retype(char* dir)
+{
+	char root[PATH_MAX], tarc[PATH_MAX], tarx[PATH_MAX];
+	char src[PATH_MAX + 8], out[PATH_MAX + 8], extracted[PATH_MAX + 16], path[PATH_MAX + 16];
+	char archives[3][PATH_MAX + 16], snapshots[3][PATH_MAX + 16], command[PATH_MAX * 2];
+	char* argv[8];
+	int i, n, ok = 1;
+
+	if(realpath("tarc", tarc) == NULL || realpath("tarx", tarx) == NULL)
+	{
+		perror("realpath (run tarbench from the directory with tarc and tarx)");
+		return 1;
+	}
+	snprintf(command, sizeof(command), "rm -rf '%s'", dir);
+	system(command);
+	make_dir(dir);
+	realpath(dir, root);
+
+	snprintf(src, sizeof(src), "%s/src", root);
+	snprintf(out, sizeof(out), "%s/out", root);
+	snprintf(extracted, sizeof(extracted), "%s/src", out);
+	make_dir(src);
+	make_dir(out);
+	snprintf(path, sizeof(path), "%s/z", src);
+	make_file(path, 1000, 0);
+	swap_types(src, 0);
+
+	for(i = 0; i < 3 && ok; i++)
+	{
+		snprintf(archives[i], sizeof(archives[i]), "%s/%d.tar", root, i);
+		snprintf(snapshots[i], sizeof(snapshots[i]), "%s/%d.snap", root, i);
+		if(i > 0)
+			swap_types(src, i);
+
+		//the base archive writes a snapshot, every incremental is made from the one before it
+		n = 0;
+		argv[n++] = tarc;
+		argv[n++] = "-s";
+		argv[n++] = snapshots[i];
+		if(i > 0)
+		{
+			argv[n++] = "-g";
+			argv[n++] = snapshots[i - 1];
+		}
+		argv[n++] = src;
+		argv[n] = NULL;
+		ok = (run_tool(argv, NULL, archives[i], NULL) == 0);
+	}
+
+	if(ok)
+	{
+		argv[0] = tarx;
+		for(i = 0; i < 3; i++)
+			argv[i + 1] = archives[i];
+		argv[4] = NULL;
+		ok = (run_tool(argv, NULL, NULL, out) == 0);
+	}
+
+	if(!ok)
+		fprintf(stderr, "tarc or tarx failed\n");
+	else if(compare_trees(src, extracted) != 0)
+		ok = 0;
+	printf("retype\n  round trip: %s\n", ok ? "identical" : "FAILED");
+
+	snprintf(command, sizeof(command), "rm -rf '%s'", root);
+	system(command);
+
+	return !ok;
+}
+
+/* round 0 makes x a directory (with x/a and x/sub/b) and y a file, odd rounds make x a file and
+ * y a directory (with y/c), even rounds switch them back */
+void swap_types(char* src, int round)
+{
+	char x[PATH_MAX + 16], y[PATH_MAX + 16], path[PATH_MAX + 32], command[PATH_MAX * 3];
+
+	snprintf(x, sizeof(x), "%s/x", src);
+	snprintf(y, sizeof(y), "%s/y", src);
+	snprintf(command, sizeof(command), "rm -rf '%s' '%s'", x, y);
+	system(command);
+
+	if(round % 2 == 0)
+	{
+		make_dir(x);
+		snprintf(path, sizeof(path), "%s/a", x);
+		make_file(path, 100, round + 1);
+		snprintf(path, sizeof(path), "%s/sub", x);
+		make_dir(path);
+		snprintf(path, sizeof(path), "%s/sub/b", x);
+		make_file(path, 200, round + 2);
+		make_file(y, 300, round + 3);
+	}
+	else
+	{
+		make_file(x, 400, round + 4);
+		make_dir(y);
+		snprintf(path, sizeof(path), "%s/c", y);
+		make_file(path, 500, round + 5);
+	}
+}
+
+/* runs argv with stdin and stdout from and to the files in and out (when not NULL) in directory
+ * cwd (when not NULL), returns its exit status or -1 */
+int run_tool(char** argv, char* in, char* out, char* cwd)
+{
+	int in_fd = -1, out_fd = -1, status;
+	pid_t pid;
+
+	if(in != NULL && (in_fd = open(in, O_RDONLY)) < 0)
+	{
+		perror(in);
+		return -1;
+	}
+	if(out != NULL && (out_fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		perror(out);
+		return -1;
+	}
+
+	pid = spawn(argv, in_fd, out_fd, cwd);
+	if(in_fd != -1)
+		close(in_fd);
+	if(out_fd != -1)
+		close(out_fd);
+	if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status))
+		return -1;
+
+	return WEXITSTATUS(status);
+}
+
+//forks and execs argv with stdin/stdout replaced by in/out (when not -1) in directory cwd (when not NULL)
+pid_t spawn(char** argv, int in, int out, char* cwd)
+{
+	pid_t pid = fork();
+	int fd;
+
+	if(pid < 0)
+	{
+		perror("fork");
+		exit(1);
+	}
+	if(pid == 0)
+	{
+		if(in != -1)
+			dup2(in, 0);
+		if(out != -1)
+			dup2(out, 1);
+		//the pipes are all above 2, nothing else should stay open in the child
+		for(fd = 3; fd < 16; fd++)
+			close(fd);
+		if(cwd != NULL && chdir(cwd) < 0)
+		{
+			perror(cwd);
+			_exit(1);
+		}
+		execv(argv[0], argv);
+		perror(argv[0]);
+		_exit(1);
+	}
+
+	return pid;
+}
+
+//wall clock time in seconds
+double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
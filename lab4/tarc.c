@@ -6,32 +6,181 @@
  * the absolute or relative pathname of the directory to copy. Then it recursively
  * traverses the given directory and all of its contents, writing the directory and
  * file information/content in bytes. The directory can be extracted by tarx.
+ * With -i, tarc also appends a trailer index after the last entry (path, content offset, size,
+ * mode, mtime and link id of every entry) so that tarx can list the archive or pull single files
+ * out of it without reading everything that comes before them.
+ * With -s file, tarc also writes a snapshot manifest (inode, size, mtime and path of every entry,
+ * one per line). Given the snapshot of an earlier run with -g file, it makes an incremental archive:
+ * files whose inode, size and mtime are unchanged are left out, and paths that have disappeared
+ * get deletion records. The deletion records come before every entry, so a path that changed
+ * between a file and a directory is already clear of anything that was under it when tarx gets to
+ * it. Directories and hard-linked files are always written. Extracting the base archive and then
+ * each incremental in order with tarx reproduces the directory.
+ * With -d, files whose contents are identical to a file already in the archive (but that aren't
+ * hard links to it) are written as a reference to that file instead of a second copy. Contents
+ * are matched by a 64-bit FNV-1a hash and compared in full before a reference is written.
+ * Hard links are found with a hash table keyed on (st_dev, st_ino). Only files with more than one
+ * link are kept in it, and each gets a link id numbered from 1. The id is what goes in the archive
+ * after the path; every other entry gets 0, which tells tarx it never has to remember the path.
  * 10/11/2020 */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
+#include <sys/types.h>
 #include <sys/stat.h>
 #include "jrb.h"
 #include "dllist.h"
+#include "inotab.h"
 
-void rec_directory(char* fn, char* origin, JRB inodes);
+//last 8 bytes of an archive that has a trailer index
+#define INDEX_MAGIC "tarcidx1"
+
+//one record of the trailer index, offset is where the file's content starts in the archive
+typedef struct index_entry
+{
+	char* path;
+	long offset;
+	long size;
+	int mode;
+	long mtime;
+	long link_id;
+} *Entry;
+
+//value of the link table for a file with more than one link
+typedef struct link
+{
+	long id;
+	Entry entry;
+} *Link;
+
+//one line of a snapshot manifest loaded with -g, seen is set by mark_seen() when the path still exists
+typedef struct snapshot_line
+{
+	long inode;
+	long size;
+	long mtime;
+	int seen;
+} *Snapshot;
+
+//a file whose contents are in the archive, kept by content hash for -d
+typedef struct content
+{
+	char* path;
+	char* disk_path;
+	long size;
+	long offset;
+} *Content;
+
+void rec_directory(char* fn, char* origin, Inotab links);
 char* get_suffix(char* full_path);
+void put(const void* ptr, size_t size);
+Entry add_entry(char* path, struct stat* buf, long offset, long size, long link_id);
+void write_index();
+JRB read_snapshot(char* fn);
+int snapshot_entry(char* path, struct stat* buf);
+void mark_seen(char* fn, char* path);
+void write_deletions();
+Entry write_content(char* disk_path, char* archive_path, struct stat* buf, long link_id);
+unsigned long hash_content(char* content, long size);
+Content find_duplicate(char* content, long size, unsigned long hash);
+int compare_hash(Jval a, Jval b);
+
+//last link id handed out, ids start at 1 because 0 means "not a link"
+long last_link_id = 0;
+//number of bytes written to stdout so far, stdout may be a pipe so ftell() can't be used
+long archive_pos = 0;
+//index entries in archive order, NULL unless -i was given
+Dllist index_entries = NULL;
+//snapshot of the previous run keyed by path (-g), and manifest being written for this run (-s)
+JRB previous = NULL;
+FILE* snapshot = NULL;
+//content hash -> Content of every file written so far, NULL unless -d was given
+JRB contents = NULL;
 
 int main(int argc, char** argv)
 {
-	if(argc < 2)
+	long i;
+	JRB tmp;
+	Content c;
+
+	for(i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if(strcmp(argv[i], "-i") == 0)
+			index_entries = new_dllist();
+		else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+		{
+			snapshot = fopen(argv[++i], "w");
+			if(snapshot == NULL)
+			{
+				perror(argv[i]);
+				exit(1);
+			}
+		}
+		else if(strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+			previous = read_snapshot(argv[++i]);
+		else if(strcmp(argv[i], "-d") == 0)
+			contents = make_jrb();
+		else
+			break;
+	}
+
+	if(i != argc - 1)
 	{
-		fprintf(stderr, "usage: %s <pathname>\n", argv[0]);
+		fprintf(stderr, "usage: %s [-i] [-d] [-s new-snapshot] [-g previous-snapshot] <pathname>\n", argv[0]);
 		exit(1);
 	}
 	
-	JRB inodes = make_jrb();
+	Inotab links = make_inotab();
 	char* origin = NULL;
-	rec_directory(argv[1], origin, inodes);
 
-	jrb_free_tree(inodes);
+	//paths that have disappeared are deleted before anything is written in their place
+	if(previous != NULL)
+	{
+		origin = get_suffix(argv[i]);
+		mark_seen(argv[i], origin);
+		free(origin);
+		origin = NULL;
+		write_deletions();
+	}
+
+	rec_directory(argv[i], origin, links);
+
+	if(index_entries != NULL)
+		write_index();
+
+	if(snapshot != NULL)
+		fclose(snapshot);
+
+	if(previous != NULL)
+	{
+		jrb_traverse(tmp, previous)
+		{
+			free(tmp->key.s);
+			free(tmp->val.v);
+		}
+		jrb_free_tree(previous);
+	}
+
+	if(contents != NULL)
+	{
+		jrb_traverse(tmp, contents)
+		{
+			c = (Content) tmp->val.v;
+			free(c->path);
+			free(c->disk_path);
+			free(c);
+		}
+		jrb_free_tree(contents);
+	}
+
+	for(i = 0; i < links->size; i++)
+	{
+		if(links->slots[i].used)
+			free(links->slots[i].val.v);
+	}
+	inotab_free(links);
 
 	return 0;
 }
@@ -39,7 +188,7 @@ int main(int argc, char** argv)
 /* recursively traverse the given directory and all of its contents and write info to stdout
  * the majority of the program is executed here
  * based on Dr. Plank's Prsize lecture */
-void rec_directory(char *fn, char* origin, JRB inodes)
+void rec_directory(char *fn, char* origin, Inotab links)
 {
 	/* each call of this function represents a parent directory to be fully traversed
 	 * near the end it is called again on all children directories
@@ -48,9 +197,12 @@ void rec_directory(char *fn, char* origin, JRB inodes)
 	struct dirent *de;
 	struct stat buf;
 	int exists, name_size;
+	long link_id = 0;
+	Inoslot slot;
+	Link link;
+	Entry entry;
 	char *this_origin, *cur_path, *file_path;
 	Dllist directories, tmp;
-	FILE *f;
 	
 	d = opendir(fn);
 	if(d == NULL)
@@ -80,13 +232,14 @@ void rec_directory(char *fn, char* origin, JRB inodes)
 			 * every subsequent call is a parent directory, but its information has
 			 * already been printed by its parent's traversal */
 			this_origin = strdup(suffix);
+			snapshot_entry(this_origin, &buf);
 			name_size = strlen(this_origin);
-			fwrite(&name_size, 4, 1, stdout);
-			fwrite(this_origin, 1, strlen(this_origin), stdout);
-			fwrite(&buf.st_ino, sizeof(buf.st_ino), 1, stdout);
-			jrb_insert_int(inodes, buf.st_ino, JNULL);
-			fwrite(&buf.st_mode, sizeof(int), 1, stdout);
-			fwrite(&buf.st_mtime, sizeof(buf.st_mtime), 1, stdout);
+			put(&name_size, 4);
+			put(this_origin, strlen(this_origin));
+			put(&link_id, sizeof(long));
+			add_entry(this_origin, &buf, -1, 0, 0);
+			put(&buf.st_mode, sizeof(int));
+			put(&buf.st_mtime, sizeof(buf.st_mtime));
 		}
 	}
 	else
@@ -112,44 +265,54 @@ void rec_directory(char *fn, char* origin, JRB inodes)
 		{
 			fprintf(stderr, "Couldn't stat %s\n", cur_path);
 		}
-		//if current child exists and is not the "." or ".." self or parent references, print child's info
-		else if(strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0)
+		/* if current child exists and is not the "." or ".." self or parent references, print child's info
+		 * snapshot_entry() returns 1 for files unchanged since the previous snapshot, which are left out */
+		else if(strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0 && !snapshot_entry(file_path, &buf))
 		{	
-			//print the path size, the path, and the inode number for all children
+			//print the path size, the path, and the link id for all children
 			name_size = strlen(file_path);
-			fwrite(&name_size, 4, 1, stdout);
-			fwrite(file_path, 1, strlen(file_path), stdout);
-			fwrite(&buf.st_ino, sizeof(buf.st_ino), 1, stdout);
+			put(&name_size, 4);
+			put(file_path, strlen(file_path));
+
+			//only files with more than one link can be hard links, everything else has a link id of 0
+			link_id = 0;
+			slot = NULL;
+			if(!S_ISDIR(buf.st_mode) && buf.st_nlink > 1)
+			{
+				slot = inotab_find(links, buf.st_dev, buf.st_ino);
+				link_id = (slot != NULL) ? ((Link) slot->val.v)->id : ++last_link_id;
+			}
+			put(&link_id, sizeof(long));
 	
-			/* if this doesn't return NULL then the inode already exists, this child is a link and does not
+			/* if a slot was found then the inode has already been written, this child is a link and does not
 			 * need the rest of its info printed */
-			if(jrb_find_int(inodes, buf.st_ino) == NULL)
+			if(slot == NULL)
 			{	
-				jrb_insert_int(inodes, buf.st_ino, JNULL);
-
 				//print the current child's mode and last modification time
-				fwrite(&buf.st_mode, sizeof(int), 1, stdout);
-				fwrite(&buf.st_mtime, sizeof(buf.st_mtime), 1, stdout);
+				put(&buf.st_mode, sizeof(int));
+				put(&buf.st_mtime, sizeof(buf.st_mtime));
 				
+				//directories have no content, so they are indexed with an offset of -1
+				if(S_ISDIR(buf.st_mode))
+					entry = add_entry(file_path, &buf, -1, 0, 0);
 				//if the current child is not a directory, print its file size and contents
-				if(!S_ISDIR(buf.st_mode))
+				else
+					entry = write_content(cur_path, file_path, &buf, link_id);
+
+				if(link_id != 0)
 				{
-					fwrite(&buf.st_size, sizeof(buf.st_size), 1, stdout);
-
-					f = fopen(cur_path, "rb");
-					if(f == NULL)
-					{
-						fprintf(stderr, "couldn't open file %s\n", de->d_name);
-						exit(1);
-					}
-				
-					char* content = malloc(buf.st_size);
-					fread(content, 1, buf.st_size, f);
-					fwrite(content, 1, buf.st_size, stdout);
-					free(content);
-					fclose(f);
+					link = malloc(sizeof(struct link));
+					link->id = link_id;
+					link->entry = entry;
+					inotab_insert(links, buf.st_dev, buf.st_ino, new_jval_v(link));
 				}
 			}
+			//a hard link is indexed with the content of the first name it was archived under
+			else if(((Link) slot->val.v)->entry != NULL)
+			{
+				entry = ((Link) slot->val.v)->entry;
+				add_entry(file_path, &buf, entry->offset, entry->size, link_id);
+			}
 		}
 		//if current child is a directory, add it to list to traverse after all children are examined
 		if(S_ISDIR(buf.st_mode) && strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0)
@@ -164,7 +327,7 @@ void rec_directory(char *fn, char* origin, JRB inodes)
 	dll_traverse(tmp, directories)
 	{
 		//recursive call on every child directory in this parent directory. Saved path is not used for anything else, free it
-		rec_directory(tmp->val.s, this_origin, inodes);
+		rec_directory(tmp->val.s, this_origin, links);
 		free(tmp->val.s);
 	}
 
@@ -173,6 +336,316 @@ void rec_directory(char *fn, char* origin, JRB inodes)
 	free_dllist(directories);
 }
 
+//writes bytes of the archive to stdout and keeps track of the current position for the index
+void put(const void* ptr, size_t size)
+{
+	fwrite(ptr, 1, size, stdout);
+	archive_pos += size;
+}
+
+//saves an index record for a path, does nothing if no index is being built
+Entry add_entry(char* path, struct stat* buf, long offset, long size, long link_id)
+{
+	Entry entry;
+
+	if(index_entries == NULL)
+		return NULL;
+
+	entry = malloc(sizeof(struct index_entry));
+	entry->path = strdup(path);
+	entry->offset = offset;
+	entry->size = size;
+	entry->mode = buf->st_mode;
+	entry->mtime = buf->st_mtime;
+	entry->link_id = link_id;
+	dll_append(index_entries, new_jval_v(entry));
+
+	return entry;
+}
+
+/* writes the trailer: a path size of 0 ends the entries (a real entry never has an empty path),
+ * then every index record, then where the index starts, the number of records and the magic.
+ * The footer has a fixed size so tarx can find the index from the end of the file */
+void write_index()
+{
+	Dllist tmp;
+	Entry entry;
+	int name_size = 0;
+	long index_start, count = 0;
+
+	put(&name_size, 4);
+	index_start = archive_pos;
+
+	dll_traverse(tmp, index_entries)
+	{
+		entry = (Entry) tmp->val.v;
+		name_size = strlen(entry->path);
+		put(&name_size, 4);
+		put(entry->path, name_size);
+		put(&entry->offset, sizeof(long));
+		put(&entry->size, sizeof(long));
+		put(&entry->mode, sizeof(int));
+		put(&entry->mtime, sizeof(long));
+		put(&entry->link_id, sizeof(long));
+		count++;
+
+		free(entry->path);
+		free(entry);
+	}
+
+	put(&index_start, sizeof(long));
+	put(&count, sizeof(long));
+	put(INDEX_MAGIC, 8);
+
+	free_dllist(index_entries);
+}
+
+/* loads a manifest written by -s into a tree keyed by path. Each line is "inode size mtime path",
+ * the path is last so it may contain spaces */
+JRB read_snapshot(char* fn)
+{
+	FILE* f;
+	JRB t;
+	Snapshot s;
+	char* line = NULL;
+	size_t line_size = 0;
+	ssize_t len;
+	int path_start;
+
+	f = fopen(fn, "r");
+	if(f == NULL)
+	{
+		perror(fn);
+		exit(1);
+	}
+
+	t = make_jrb();
+	while((len = getline(&line, &line_size, f)) > 0)
+	{
+		if(line[len - 1] == '\n')
+			line[len - 1] = '\0';
+
+		s = malloc(sizeof(struct snapshot_line));
+		s->seen = 0;
+		if(sscanf(line, "%ld %ld %ld %n", &s->inode, &s->size, &s->mtime, &path_start) != 3 || line[path_start] == '\0')
+		{
+			fprintf(stderr, "%s: bad snapshot line: %s\n", fn, line);
+			exit(1);
+		}
+		jrb_insert_str(t, strdup(line + path_start), new_jval_v(s));
+	}
+
+	free(line);
+	fclose(f);
+
+	return t;
+}
+
+/* records an entry in the new snapshot. Returns 1 if the entry can be left out of an incremental archive: a regular file with a single
+ * link whose inode, size and mtime match the previous snapshot. Hard-linked files are always
+ * written because tarx can only relink names that appear in the same archive */
+int snapshot_entry(char* path, struct stat* buf)
+{
+	JRB old;
+	Snapshot s;
+
+	if(snapshot != NULL)
+		fprintf(snapshot, "%ld %ld %ld %s\n", (long) buf->st_ino, (long) buf->st_size, (long) buf->st_mtime, path);
+
+	if(previous == NULL)
+		return 0;
+
+	old = jrb_find_str(previous, path);
+	if(old == NULL)
+		return 0;
+
+	s = (Snapshot) old->val.v;
+
+	return !S_ISDIR(buf->st_mode) && buf->st_nlink == 1 && s->inode == buf->st_ino && s->size == buf->st_size && s->mtime == buf->st_mtime;
+}
+
+/* writes a deletion record (negative path size, then the path) for every path in the previous
+ * snapshot that wasn't found this time. Reverse order puts everything under a directory before
+ * the directory itself, so tarx can remove them in order */
+void write_deletions()
+{
+	JRB tmp;
+	int name_size;
+
+	jrb_rtraverse(tmp, previous)
+	{
+		if(!((Snapshot) tmp->val.v)->seen)
+		{
+			name_size = -strlen(tmp->key.s);
+			put(&name_size, 4);
+			put(tmp->key.s, strlen(tmp->key.s));
+		}
+	}
+}
+
+/* walks the directory fn, archived as path, the way rec_directory() will and marks every path
+ * that is in the previous snapshot as seen, so the deletions are known before any entry is written */
+void mark_seen(char* fn, char* path)
+{
+	DIR* d;
+	struct dirent* de;
+	struct stat buf;
+	JRB old;
+	char *cur_path, *file_path;
+
+	old = jrb_find_str(previous, path);
+	if(old != NULL)
+		((Snapshot) old->val.v)->seen = 1;
+
+	d = opendir(fn);
+	if(d == NULL)
+		return;
+	for(de = readdir(d); de != NULL; de = readdir(d))
+	{
+		if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+
+		cur_path = malloc(strlen(fn) + strlen(de->d_name) + 2);
+		sprintf(cur_path, "%s/%s", fn, de->d_name);
+		file_path = malloc(strlen(path) + strlen(de->d_name) + 2);
+		sprintf(file_path, "%s/%s", path, de->d_name);
+
+		if(lstat(cur_path, &buf) == 0 && S_ISDIR(buf.st_mode))
+			mark_seen(cur_path, file_path);
+		else if((old = jrb_find_str(previous, file_path)) != NULL)
+			((Snapshot) old->val.v)->seen = 1;
+
+		free(cur_path);
+		free(file_path);
+	}
+	closedir(d);
+}
+
+/* prints a regular file's size and contents and returns its index entry. With -d, a file identical
+ * to one already written gets a size of -1 and the earlier file's path instead of its contents */
+Entry write_content(char* disk_path, char* archive_path, struct stat* buf, long link_id)
+{
+	FILE* f;
+	char* content;
+	unsigned long hash = 0;
+	long ref_size = -1, offset;
+	int name_size;
+	Content dup = NULL, c;
+	Entry entry;
+
+	f = fopen(disk_path, "rb");
+	if(f == NULL)
+	{
+		fprintf(stderr, "couldn't open file %s\n", disk_path);
+		exit(1);
+	}
+
+	content = malloc(buf->st_size);
+	fread(content, 1, buf->st_size, f);
+	fclose(f);
+
+	if(contents != NULL)
+	{
+		hash = hash_content(content, buf->st_size);
+		dup = find_duplicate(content, buf->st_size, hash);
+	}
+
+	//a reference is only worth writing if it is smaller than the contents it replaces
+	if(dup != NULL && buf->st_size > strlen(dup->path) + sizeof(int))
+	{
+		put(&ref_size, sizeof(long));
+		name_size = strlen(dup->path);
+		put(&name_size, 4);
+		put(dup->path, name_size);
+		entry = add_entry(archive_path, buf, dup->offset, buf->st_size, link_id);
+	}
+	else
+	{
+		put(&buf->st_size, sizeof(buf->st_size));
+		offset = archive_pos;
+		put(content, buf->st_size);
+		entry = add_entry(archive_path, buf, offset, buf->st_size, link_id);
+
+		if(contents != NULL && dup == NULL)
+		{
+			c = malloc(sizeof(struct content));
+			c->path = strdup(archive_path);
+			c->disk_path = strdup(disk_path);
+			c->size = buf->st_size;
+			c->offset = offset;
+			jrb_insert_gen(contents, new_jval_l(hash), new_jval_v(c), compare_hash);
+		}
+	}
+
+	free(content);
+
+	return entry;
+}
+
+//64-bit FNV-1a
+unsigned long hash_content(char* content, long size)
+{
+	unsigned long hash = 14695981039346656037UL;
+	long i;
+
+	for(i = 0; i < size; i++)
+	{
+		hash ^= (unsigned char) content[i];
+		hash *= 1099511628211UL;
+	}
+
+	return hash;
+}
+
+/* looks for an earlier file with the same hash and size whose contents really are the same. The
+ * earlier file is read back from disk and compared, so a hash collision can't corrupt the archive */
+Content find_duplicate(char* content, long size, unsigned long hash)
+{
+	JRB tmp;
+	Content c;
+	FILE* f;
+	char block[8192];
+	long pos, n;
+	int found;
+
+	for(tmp = jrb_find_gte_gen(contents, new_jval_l(hash), compare_hash, &found); found && tmp != jrb_nil(contents); tmp = jrb_next(tmp))
+	{
+		if(compare_hash(tmp->key, new_jval_l(hash)) != 0)
+			break;
+
+		c = (Content) tmp->val.v;
+		if(c->size != size)
+			continue;
+
+		f = fopen(c->disk_path, "rb");
+		if(f == NULL)
+			continue;
+		for(pos = 0; pos < size; pos += n)
+		{
+			n = size - pos < sizeof(block) ? size - pos : sizeof(block);
+			n = fread(block, 1, n, f);
+			if(n <= 0 || memcmp(block, content + pos, n) != 0)
+				break;
+		}
+		fclose(f);
+
+		if(pos == size)
+			return c;
+	}
+
+	return NULL;
+}
+
+//comparison for the content tree, hashes are compared unsigned
+int compare_hash(Jval a, Jval b)
+{
+	if((unsigned long) a.l < (unsigned long) b.l)
+		return -1;
+	if((unsigned long) a.l > (unsigned long) b.l)
+		return 1;
+	return 0;
+}
+
 //gets suffix (last /* end of path) from absolute path
 char* get_suffix(char* full_path)
 {
@@ -5,6 +5,16 @@
  * a tarfile. It reads the tarfile from stdin and creates the files in order, filling files
  * (not directories) with content as necessary and setting their modification times. At the
  * end, all directories' modes and modification times are set.
+ * Archives made with tarc -i end in a trailer index. "tarx -t archive" lists such an archive and
+ * "tarx -x archive path ..." extracts only the given paths (and everything under given directories)
+ * by mmap'ing the archive and copying each file's content straight from its indexed offset.
+ * "tarx archive ..." extracts each archive in order, which applies a base archive followed by a
+ * chain of incremental archives made with tarc -g. Existing files are replaced, and deletion
+ * records remove paths that no longer exist. A path that has changed between a file and a
+ * directory is removed before the new one is made. Files that tarc -d stored as a reference to an
+ * identical earlier file are filled in by copying that file once it has been extracted.
+ * Paths are remembered for hard links in a hash table keyed on the link id that follows each
+ * path. Entries with a link id of 0 aren't links, so their paths are never stored.
  * 10/11/2020 */
 
 #include <stdio.h>
@@ -14,61 +24,183 @@
 #include <sys/types.h>
 #include <utime.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "jrb.h"
 #include "dllist.h"
+#include "inotab.h"
+
+//last 8 bytes of an archive that has a trailer index, see write_index() in tarc.c
+#define INDEX_MAGIC "tarcidx1"
+//index start, record count and magic
+#define FOOTER_SIZE (2 * sizeof(long) + 8)
+
+//one record of the trailer index, pointing into the mapped archive
+typedef struct index_record
+{
+	char* path;
+	long offset;
+	long size;
+	int mode;
+	long mtime;
+	long link_id;
+} *Record;
+
+//trailer index of an mmap'd archive. Records are kept in archive order for listing and in a tree by path for lookups
+typedef struct archive_index
+{
+	char* map;
+	long map_size;
+	Dllist records;
+	JRB paths;
+} *Index;
+
+void extract_stream(FILE* in);
+Index open_index(char* fn);
+void list_index(Index index);
+int extract_paths(Index index, char** paths, int npaths);
+void extract_record(Index index, Record r, Inotab links, JRB d_modes, JRB d_times);
+void make_parents(char* path);
+void clear_path(char* path, int is_dir);
+void set_directories(JRB d_modes, JRB d_times);
+void free_index(Index index);
+int copy_reference(FILE* in, FILE* f);
 
 /* all errors close files and free any memory that was allocated before the error check,
  * then calls this to free structures */
-void free_error(JRB inodes, JRB d_modes, JRB d_times);
+void free_error(Inotab links, JRB d_modes, JRB d_times);
+
+int main(int argc, char** argv)
+{
+	Index index;
+	FILE* in;
+	int i, status = 0;
+
+	//no arguments: extract the tarfile on stdin like before
+	if(argc == 1)
+	{
+		extract_stream(stdin);
+		return 0;
+	}
+
+	if(argc == 3 && strcmp(argv[1], "-t") == 0)
+	{
+		index = open_index(argv[2]);
+		list_index(index);
+	}
+	else if(argc >= 4 && strcmp(argv[1], "-x") == 0)
+	{
+		index = open_index(argv[2]);
+		status = extract_paths(index, argv + 3, argc - 3);
+	}
+	else if(argv[1][0] != '-')
+	{
+		//base archive followed by incrementals, each one is applied on top of the last
+		for(i = 1; i < argc; i++)
+		{
+			in = fopen(argv[i], "rb");
+			if(in == NULL)
+			{
+				perror(argv[i]);
+				exit(1);
+			}
+			extract_stream(in);
+			fclose(in);
+		}
+		return 0;
+	}
+	else
+	{
+		fprintf(stderr, "usage: %s [archive ... | -t archive | -x archive path ...] (no arguments reads a tarfile from stdin)\n", argv[0]);
+		exit(1);
+	}
+
+	free_index(index);
 
-int main()
+	return status;
+}
+
+//extracts every entry of a tarfile read sequentially from in, stopping at EOF or at the start of a trailer index
+void extract_stream(FILE* in)
 {
-	JRB inodes = make_jrb();
+	Inotab links = make_inotab();
+	Inoslot slot;
 	JRB d_modes = make_jrb();
 	JRB d_times = make_jrb();
-	JRB tmp;
 	FILE *f;
 	int path_size, mode;
-	long inode, mtime, f_size;
+	long i, link_id, mtime, f_size;
 	char *path, *dup_path, *content;
 	struct timeval *times;
 
 	/* when fread fails to read in a path_size properly, reached EOF (or error)
 	 * read info for every directory/file in order of tarfile */
-	while(fread(&path_size, sizeof(int), 1, stdin) == 1)
+	while(fread(&path_size, sizeof(int), 1, in) == 1)
 	{
+		/* a path size of 0 marks the end of the entries, only the trailer index follows. It is read and
+		 * thrown away so that tarc -i writing into a pipe isn't killed by SIGPIPE */
+		if(path_size == 0)
+		{
+			content = malloc(8192);
+			while(fread(content, 1, 8192, in) > 0);
+			free(content);
+			break;
+		}
+
+		//a negative path size is a deletion record from an incremental archive, only the path follows
+		if(path_size < 0)
+		{
+			path_size = -path_size;
+			path = malloc(path_size + 1);
+			if(fread(path, 1, path_size, in) != path_size)
+			{
+				perror("given path size does not match existing path\n");
+				free(path);
+				free_error(links, d_modes, d_times);
+				exit(1);
+			}
+			path[path_size] = '\0';
+			//records come children first, so remove() only ever sees empty directories
+			remove(path);
+			free(path);
+			continue;
+		}
+
 		//read in path string after path size, add '\0' at the end
 		path = malloc(path_size + 1);
-		if(fread(path, 1, path_size, stdin) != path_size)
+		if(fread(path, 1, path_size, in) != path_size)
 		{
 			perror("given path size does not match existing path\n");
 			free(path);
-			free_error(inodes, d_modes, d_times);
+			free_error(links, d_modes, d_times);
 			exit(1);
 		}
 		path[path_size] = '\0';	
 		
-		//read in inode number
-		fread(&inode, sizeof(long), 1, stdin);
+		//read in link id, 0 means this entry can't be a hard link (old archives have an inode number for everything)
+		fread(&link_id, sizeof(long), 1, in);
+		slot = (link_id != 0) ? inotab_find(links, 0, link_id) : NULL;
 		
-		//if inode number has been read before, skip reading the extra info, create hard link, and move to next file
-		if(jrb_find_int(inodes, inode) == NULL)
+		//if link id has been read before, skip reading the extra info, create hard link, and move to next file
+		if(slot == NULL)
 		{	
-			jrb_insert_int(inodes, inode, new_jval_s(strdup(path)));
+			if(link_id != 0)
+				inotab_insert(links, 0, link_id, new_jval_s(strdup(path)));
 			
 			//read in mode, then modification time
-			if(fread(&mode, sizeof(int), 1, stdin) != 1)
+			if(fread(&mode, sizeof(int), 1, in) != 1)
 			{
 				perror("couldn't read mode\n");
 				free(path);
-				free_error(inodes, d_modes, d_times);
+				free_error(links, d_modes, d_times);
 				exit(1);
 			}
-			if(fread(&mtime, sizeof(long), 1, stdin) != 1)
+			if(fread(&mtime, sizeof(long), 1, in) != 1)
 			{
 				perror("couldn't read mtime\n");
 				free(path);
-				free_error(inodes, d_modes, d_times);
+				free_error(links, d_modes, d_times);
 				exit(1);
 			}
 
@@ -86,35 +218,55 @@ int main()
 				dup_path = strdup(path);
 				jrb_insert_str(d_modes, dup_path, new_jval_i(mode)); 
 				jrb_insert_str(d_times, dup_path, new_jval_v(times));
+				clear_path(path, 1);
 				mkdir(path, 0777);
 			}
 			else
 			{
-				//otherwise its a file. Create it and read in its contents from tarfile
+				/* otherwise its a file. Create it and read in its contents from tarfile
+				 * an existing file is unlinked first so writing can't go through an old hard link */
+				clear_path(path, 0);
 				f = fopen(path, "w");
 				if(f == NULL)
 				{
 					perror("couldn't open file\n");
 					free(path);
 					free(times);
-					free_error(inodes, d_modes, d_times);
+					free_error(links, d_modes, d_times);
 					exit(1);
 				}
-				fread(&f_size, sizeof(long), 1, stdin);
-				content = malloc(f_size);
-				if(fread(content, 1, f_size, stdin) != f_size)
+				fread(&f_size, sizeof(long), 1, in);
+				//a size of -1 means the contents are identical to an earlier file in this archive (tarc -d)
+				if(f_size == -1)
 				{
-					perror("couldn't read file contents\n");
-					free(path);
-					free(times);
-					free(content);
+					if(copy_reference(in, f) < 0)
+					{
+						perror("couldn't copy duplicate contents\n");
+						free(path);
+						free(times);
+						fclose(f);
+						free_error(links, d_modes, d_times);
+						exit(1);
+					}
 					fclose(f);
-					free_error(inodes, d_modes, d_times);
-					exit(1);
 				}
-				fwrite(content, 1, f_size, f);
-				fclose(f);
-				free(content);
+				else
+				{
+					content = malloc(f_size);
+					if(fread(content, 1, f_size, in) != f_size)
+					{
+						perror("couldn't read file contents\n");
+						free(path);
+						free(times);
+						free(content);
+						fclose(f);
+						free_error(links, d_modes, d_times);
+						exit(1);
+					}
+					fwrite(content, 1, f_size, f);
+					fclose(f);
+					free(content);
+				}
 				//set file's mode and modification time
 				chmod(path, mode);
 				utimes(path, times);
@@ -123,7 +275,8 @@ int main()
 		}
 		else
 		{
-			link(jrb_find_int(inodes, inode)->val.s, path);
+			clear_path(path, 0);
+			link(slot->val.s, path);
 		}
 		free(path);
 	}
@@ -132,11 +285,22 @@ int main()
 	 * modification times for directories. Rather than call free_error to free memory
 	 * separately and have to traverse the directory tree twice */
 	
-	jrb_traverse(tmp, inodes)
+	for(i = 0; i < links->size; i++)
 	{
-		free(tmp->val.s);
+		if(links->slots[i].used)
+			free(links->slots[i].val.s);
 	}
 	
+	set_directories(d_modes, d_times);
+
+	inotab_free(links);
+}
+
+//sets mode and modification time of every extracted directory, then frees both trees
+void set_directories(JRB d_modes, JRB d_times)
+{
+	JRB tmp;
+
 	jrb_traverse(tmp, d_modes)
 	{
 		chmod(tmp->key.s, tmp->val.i);
@@ -149,21 +313,317 @@ int main()
 		free(tmp->val.v);
 	}
 
-	jrb_free_tree(inodes);
 	jrb_free_tree(d_modes);
 	jrb_free_tree(d_times);
+}
+
+//maps an archive and reads its trailer index, exits if the archive doesn't have one
+Index open_index(char* fn)
+{
+	struct stat buf;
+	Index index;
+	Record r;
+	char* pos;
+	char* end;
+	long index_start, count, i;
+	int fd, path_size;
+
+	fd = open(fn, O_RDONLY);
+	if(fd < 0 || fstat(fd, &buf) < 0)
+	{
+		perror(fn);
+		exit(1);
+	}
+	if(buf.st_size < FOOTER_SIZE)
+	{
+		fprintf(stderr, "%s: archive has no index (create it with tarc -i)\n", fn);
+		exit(1);
+	}
+
+	index = malloc(sizeof(struct archive_index));
+	index->map_size = buf.st_size;
+	index->map = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(index->map == MAP_FAILED)
+	{
+		perror(fn);
+		exit(1);
+	}
+
+	//footer is at the very end: index start, number of records, magic
+	end = index->map + index->map_size - FOOTER_SIZE;
+	memcpy(&index_start, end, sizeof(long));
+	memcpy(&count, end + sizeof(long), sizeof(long));
+	if(memcmp(end + 2 * sizeof(long), INDEX_MAGIC, 8) != 0 || index_start < 0 || index_start > end - index->map)
+	{
+		fprintf(stderr, "%s: archive has no index (create it with tarc -i)\n", fn);
+		exit(1);
+	}
+
+	index->records = new_dllist();
+	index->paths = make_jrb();
+
+	//records are copied out of the map since nothing in the archive is aligned or '\0' terminated
+	pos = index->map + index_start;
+	for(i = 0; i < count; i++)
+	{
+		if(end - pos < sizeof(int))
+			break;
+		memcpy(&path_size, pos, sizeof(int));
+		pos += sizeof(int);
+		if(path_size <= 0 || end - pos < path_size + 4 * sizeof(long) + sizeof(int))
+			break;
+
+		r = malloc(sizeof(struct index_record));
+		r->path = malloc(path_size + 1);
+		memcpy(r->path, pos, path_size);
+		r->path[path_size] = '\0';
+		pos += path_size;
+		memcpy(&r->offset, pos, sizeof(long));
+		pos += sizeof(long);
+		memcpy(&r->size, pos, sizeof(long));
+		pos += sizeof(long);
+		memcpy(&r->mode, pos, sizeof(int));
+		pos += sizeof(int);
+		memcpy(&r->mtime, pos, sizeof(long));
+		pos += sizeof(long);
+		memcpy(&r->link_id, pos, sizeof(long));
+		pos += sizeof(long);
+
+		//content has to lie inside the archive before the index
+		if(!S_ISDIR(r->mode) && (r->offset < 0 || r->size < 0 || r->offset > index_start - r->size))
+		{
+			free(r->path);
+			free(r);
+			break;
+		}
+
+		dll_append(index->records, new_jval_v(r));
+		jrb_insert_str(index->paths, r->path, new_jval_v(r));
+	}
+
+	if(i != count)
+	{
+		fprintf(stderr, "%s: corrupt index\n", fn);
+		exit(1);
+	}
+
+	return index;
+}
+
+//prints mode, size and path of every entry in archive order
+void list_index(Index index)
+{
+	Dllist tmp;
+	Record r;
+
+	dll_traverse(tmp, index->records)
+	{
+		r = (Record) tmp->val.v;
+		printf("%06o %10ld %s\n", r->mode, r->size, r->path);
+	}
+}
+
+/* extracts each of the given paths, and every entry under a path that is a directory.
+ * Returns 1 if any path isn't in the archive */
+int extract_paths(Index index, char** paths, int npaths)
+{
+	Inotab links = make_inotab();
+	JRB d_modes = make_jrb();
+	JRB d_times = make_jrb();
+	JRB tmp;
+	char* dir_prefix;
+	int i, len, found, status = 0;
+
+	for(i = 0; i < npaths; i++)
+	{
+		tmp = jrb_find_str(index->paths, paths[i]);
+		if(tmp == NULL)
+		{
+			fprintf(stderr, "%s: not in archive\n", paths[i]);
+			status = 1;
+			continue;
+		}
+		extract_record(index, tmp->val.v, links, d_modes, d_times);
+
+		if(!S_ISDIR(((Record) tmp->val.v)->mode))
+			continue;
+
+		/* everything under a directory is in one run of the tree starting at "dir/". It can't be
+		 * found by walking on from "dir" because names like "dir-x" sort between the two */
+		len = strlen(paths[i]);
+		dir_prefix = malloc(len + 2);
+		sprintf(dir_prefix, "%s/", paths[i]);
+		for(tmp = jrb_find_gte_str(index->paths, dir_prefix, &found); tmp != jrb_nil(index->paths); tmp = jrb_next(tmp))
+		{
+			if(strncmp(tmp->key.s, dir_prefix, len + 1) != 0)
+				break;
+			extract_record(index, tmp->val.v, links, d_modes, d_times);
+		}
+		free(dir_prefix);
+	}
+
+	set_directories(d_modes, d_times);
+	inotab_free(links);
+
+	return status;
+}
+
+//creates a single indexed entry, content is written directly from the mapped archive
+void extract_record(Index index, Record r, Inotab links, JRB d_modes, JRB d_times)
+{
+	Inoslot link_to = NULL;
+	FILE* f;
+	struct timeval* times;
+
+	make_parents(r->path);
+
+	//a directory may be reached both by name and as part of a parent's subtree
+	if(S_ISDIR(r->mode))
+	{
+		if(jrb_find_str(d_modes, r->path) != NULL)
+			return;
+		times = malloc(2 * sizeof(struct timeval));
+		times[0].tv_sec = time(NULL);
+		times[0].tv_usec = 0;
+		times[1].tv_sec = r->mtime;
+		times[1].tv_usec = 0;
+		//key string is shared by both trees and freed by set_directories()
+		mkdir(r->path, 0777);
+		jrb_insert_str(d_modes, strdup(r->path), new_jval_i(r->mode));
+		jrb_insert_str(d_times, jrb_find_str(d_modes, r->path)->key.s, new_jval_v(times));
+		return;
+	}
+
+	//other names for a file that was already extracted become hard links again
+	if(r->link_id != 0)
+		link_to = inotab_find(links, 0, r->link_id);
+	if(link_to != NULL)
+	{
+		if(strcmp(link_to->val.s, r->path) != 0)
+		{
+			unlink(r->path);
+			link(link_to->val.s, r->path);
+		}
+		return;
+	}
+
+	//an existing file is unlinked first so writing can't go through an old hard link
+	unlink(r->path);
+	f = fopen(r->path, "w");
+	if(f == NULL)
+	{
+		perror(r->path);
+		exit(1);
+	}
+	if(fwrite(index->map + r->offset, 1, r->size, f) != r->size)
+	{
+		perror(r->path);
+		exit(1);
+	}
+	fclose(f);
+
+	times = malloc(2 * sizeof(struct timeval));
+	times[0].tv_sec = time(NULL);
+	times[0].tv_usec = 0;
+	times[1].tv_sec = r->mtime;
+	times[1].tv_usec = 0;
+	chmod(r->path, r->mode);
+	utimes(r->path, times);
+	free(times);
+
+	//record paths point into the index, which outlives the link table
+	if(r->link_id != 0)
+		inotab_insert(links, 0, r->link_id, new_jval_s(r->path));
+}
+
+//creates every missing directory leading up to path, like mkdir -p on its dirname
+void make_parents(char* path)
+{
+	char* slash;
+
+	for(slash = strchr(path, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+	{
+		*slash = '\0';
+		mkdir(path, 0777);
+		*slash = '/';
+	}
+}
+
+/* makes way for an entry at path: anything there that isn't a directory is unlinked, and a
+ * directory is removed unless the entry is a directory too. tarc writes deletion records before
+ * the entries, so a directory that became a file has already been emptied */
+void clear_path(char* path, int is_dir)
+{
+	struct stat buf;
+
+	if(lstat(path, &buf) < 0)
+		return;
+	if(!S_ISDIR(buf.st_mode))
+		unlink(path);
+	else if(!is_dir)
+		rmdir(path);
+}
+
+void free_index(Index index)
+{
+	Dllist tmp;
+	Record r;
+
+	dll_traverse(tmp, index->records)
+	{
+		r = (Record) tmp->val.v;
+		free(r->path);
+		free(r);
+	}
+	free_dllist(index->records);
+	jrb_free_tree(index->paths);
+	munmap(index->map, index->map_size);
+	free(index);
+}
+
+/* reads the path of an earlier file in the archive that has the same contents and copies that
+ * file, which has already been extracted, into f. Returns -1 on error */
+int copy_reference(FILE* in, FILE* f)
+{
+	FILE* ref;
+	char block[8192];
+	char* path;
+	int path_size;
+	size_t n;
+
+	if(fread(&path_size, sizeof(int), 1, in) != 1 || path_size <= 0)
+		return -1;
+	path = malloc(path_size + 1);
+	if(fread(path, 1, path_size, in) != path_size)
+	{
+		free(path);
+		return -1;
+	}
+	path[path_size] = '\0';
+
+	ref = fopen(path, "rb");
+	free(path);
+	if(ref == NULL)
+		return -1;
+
+	while((n = fread(block, 1, sizeof(block), ref)) > 0)
+		fwrite(block, 1, n, f);
+	fclose(ref);
 
 	return 0;
 }
 
 //frees all data structs in case of error and exit
-void free_error(JRB inodes, JRB d_modes, JRB d_times)
+void free_error(Inotab links, JRB d_modes, JRB d_times)
 {
 	JRB tmp;
+	long i;
 
-	jrb_traverse(tmp, inodes)
+	for(i = 0; i < links->size; i++)
 	{
-		free(tmp->val.s);
+		if(links->slots[i].used)
+			free(links->slots[i].val.s);
 	}
 
 	jrb_traverse(tmp, d_times)
@@ -172,7 +632,7 @@ void free_error(JRB inodes, JRB d_modes, JRB d_times)
 		free(tmp->val.s);
 	}
 
-	jrb_free_tree(inodes);
+	inotab_free(links);
 	jrb_free_tree(d_modes);
 	jrb_free_tree(d_times);
 }